@@ -58,9 +58,12 @@ BookSimConfig::BookSimConfig( )
   //dragonfly_full specific 
   _int_map["df_a"] = 4; //no of routers in a group 
   _int_map["df_g"] = 9; //no of groups
-  _int_map["df_p"] = 0; //no of PEs per router. Should be  = df_a/2
+  _int_map["df_h"] = 0; //no of global links per router. 0 = df_a/2
+  _int_map["df_p"] = 0; //no of PEs per router. 0 = df_a/2
   
   AddStrField( "df_arrangement", "absolute_improved" );
+                      //Options: absolute_improved / relative / circulant / random
+  _int_map["df_arrangement_seed"] = 1; //seed of the random df_arrangement
   
   AddStrField( "ugal_multiply_mode", "one_vs_two" );  
                       //For Dragonfly ugal.
@@ -68,6 +71,26 @@ BookSimConfig::BookSimConfig( )
   
   AddStrField( "vc_allocation_mode", "incremental" );
                       //Options: incremental / optimal  
+
+  AddStrField( "par_revaluation", "first_hop" );
+                      //For dragonfly_full PAR_* routing: where a MIN path may still be re-evaluated.
+                      //Options: first_hop / source_group / source_and_intermediate_group
+
+  _int_map["djkstra_threads"] = 0; //threads for the dragonfly_full all-pair djkstra. 0 = all hardware threads
+  _int_map["djkstra_group_symmetry"] = 1; //dragonfly_full: run djkstra for one group per group-shift orbit only, if the arrangement allows it
+  _int_map["djkstra_path_pool_mb"] = 1024; //dragonfly_full: budget for precomputed djkstra paths. If they don't fit, an LRU cache of this size is used
+  _int_map["candidate_cache_mb"] = 1024; //dragonfly_full: budget of each restricted-mode i-node candidate cache. Lists that don't fit are rebuilt per packet
+
+  AddStrField( "djkstra_path_selection", "pool" );
+                      //For dragonfly_full djkstra paths.
+                      //Options: pool / sample
+
+  AddStrField( "df_topology_file", "" );
+                      //dragonfly_full: write the router graph here, input of PathSetOptimizer
+  AddStrField( "vlb_inode_table", "" );
+                      //dragonfly_full: i-node table made by PathSetOptimizer, needed by the *_table routing functions
+  AddStrField( "df_snapshot_dir", "" );
+                      //dragonfly_full: keep the djkstra tables and neighbor sets here, keyed by the topology. Empty = off
   
 
 
@@ -79,11 +102,14 @@ BookSimConfig::BookSimConfig( )
   
   _int_map["routing_threshold"] = 40; //necessary for threshold based tiered ugal routing only
     
-  _int_map["multitiered_routing_threshold_0"] = 10;
-  _int_map["multitiered_routing_threshold_1"] = 40;
+  _int_map["multitiered_routing_threshold_0"] = 10; //dragonfly_full *_multitiered routing: min path q_len below it -> three hop VLB paths
+  _int_map["multitiered_routing_threshold_1"] = 40; //below it -> four hop VLB paths, otherwise any i-node
 
   _int_map["five_hop_percentage"] = 0; //only relevant for df_full four_hop_some_five_hop_restricted routing
 
+  _int_map["ugal_min_candidates"] = 1; //dragonfly_full UGAL: no of MIN paths compared
+  _int_map["ugal_vlb_candidates"] = 1; //dragonfly_full UGAL: no of VLB paths compared. Together at most 16
+
   _int_map["local_latency"] = 1;
   _int_map["global_latency"] = 1;  
 
@@ -0,0 +1,128 @@
+#ifndef _DF_ARRAY_HPP_
+#define _DF_ARRAY_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+Read-only array that either owns its elements or looks at memory owned
+by someone else, e.g. a section of a mapped snapshot (df_snapshot.hpp).
+
+The tables are built in a std::vector and handed over with own(), or
+attached to the snapshot with view(). Readers can't tell the difference.
+*/
+
+template <typename T>
+class DFArray {
+    std::vector<T> _owned;
+    const T *_data;
+    std::size_t _size;
+
+    void take(DFArray &other){
+        bool owning = (other._data != NULL) && (other._data == other._owned.data());
+        _owned.swap(other._owned);
+        std::vector<T>().swap(other._owned);
+        _data = owning ? _owned.data() : other._data;
+        _size = other._size;
+        other._data = NULL;
+        other._size = 0;
+    }
+
+public:
+    DFArray() : _data(NULL), _size(0) {}
+
+    //_data points into _owned or at someone else's memory. A member-wise copy
+    //would point into the source's vector, so there are no copies. A move
+    //takes the vector and points _data at it again.
+    DFArray(const DFArray &) = delete;
+    DFArray & operator=(const DFArray &) = delete;
+    DFArray(DFArray &&other) : _data(NULL), _size(0) { take(other); }
+    DFArray & operator=(DFArray &&other){
+        if (this != &other){
+            take(other);
+        }
+        return *this;
+    }
+
+    //takes the elements of v, v is left empty
+    void own(std::vector<T> &v){
+        _owned.swap(v);
+        std::vector<T>().swap(v);
+        _data = _owned.data();
+        _size = _owned.size();
+    }
+
+    //data must outlive the array
+    void view(const T *data, std::size_t size){
+        std::vector<T>().swap(_owned);
+        _data = data;
+        _size = size;
+    }
+
+    void clear(){
+        std::vector<T>().swap(_owned);
+        _data = NULL;
+        _size = 0;
+    }
+
+    inline const T & operator[](std::size_t ii) const { return _data[ii]; }
+    inline const T * data() const { return _data; }
+    inline std::size_t size() const { return _size; }
+    inline std::size_t bytes() const { return _size * sizeof(T); }
+    inline const T & back() const { return _data[_size - 1]; }
+};
+
+/*
+num_rows read-only lists back to back, list r is items[offsets[r] .. offsets[r+1]).
+Only offsets, no pointers, so a snapshot section can be used as is.
+lists[r] reads like a const vector.
+*/
+
+template <typename T>
+struct DFListView {
+    const T *first;
+    const T *last;
+
+    inline std::size_t size() const { return last - first; }
+    inline bool empty() const { return first == last; }
+    inline const T & operator[](std::size_t ii) const { return first[ii]; }
+    inline const T * begin() const { return first; }
+    inline const T * end() const { return last; }
+};
+
+template <typename T>
+class DFFlatLists {
+public:
+    DFArray<uint32_t> offsets;
+    DFArray<T> items;
+
+    //takes the lists of v, v is left empty
+    void own(std::vector< std::vector<T> > &v){
+        std::vector<uint32_t> new_offsets(1, 0);
+        std::vector<T> new_items;
+        std::size_t ii;
+
+        for (ii = 0; ii < v.size(); ii++){
+            new_offsets.push_back(new_offsets.back() + v[ii].size());
+        }
+        new_items.reserve(new_offsets.back());
+        for (ii = 0; ii < v.size(); ii++){
+            new_items.insert(new_items.end(), v[ii].begin(), v[ii].end());
+        }
+        std::vector< std::vector<T> >().swap(v);
+
+        offsets.own(new_offsets);
+        items.own(new_items);
+    }
+
+    inline std::size_t num_rows() const { return offsets.size() == 0 ? 0 : offsets.size() - 1; }
+    inline std::size_t bytes() const { return offsets.bytes() + items.bytes(); }
+
+    inline DFListView<T> operator[](std::size_t r) const {
+        DFListView<T> list = {items.data() + offsets[r], items.data() + offsets[r + 1]};
+        return list;
+    }
+};
+
+#endif
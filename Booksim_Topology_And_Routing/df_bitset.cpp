@@ -0,0 +1,141 @@
+/*
+Bitset operations for df_bitset.hpp.
+
+Each bulk operation has a SIMD main loop for whatever the compiler targets
+and a scalar loop that does the tail (and everything, without SIMD).
+*/
+
+#include "df_bitset.hpp"
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+void df_bits_or(uint64_t *dst, const uint64_t *a, const uint64_t *b, int n_words){
+    int ii = 0;
+#if defined(__AVX512F__)
+    for (; ii + 8 <= n_words; ii += 8){
+        __m512i va = _mm512_loadu_si512((const void *)(a + ii));
+        __m512i vb = _mm512_loadu_si512((const void *)(b + ii));
+        _mm512_storeu_si512((void *)(dst + ii), _mm512_or_si512(va, vb));
+    }
+#elif defined(__AVX2__)
+    for (; ii + 4 <= n_words; ii += 4){
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + ii));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + ii));
+        _mm256_storeu_si256((__m256i *)(dst + ii), _mm256_or_si256(va, vb));
+    }
+#endif
+    for (; ii < n_words; ii++){
+        dst[ii] = a[ii] | b[ii];
+    }
+}
+
+void df_bits_and(uint64_t *dst, const uint64_t *a, const uint64_t *b, int n_words){
+    int ii = 0;
+#if defined(__AVX512F__)
+    for (; ii + 8 <= n_words; ii += 8){
+        __m512i va = _mm512_loadu_si512((const void *)(a + ii));
+        __m512i vb = _mm512_loadu_si512((const void *)(b + ii));
+        _mm512_storeu_si512((void *)(dst + ii), _mm512_and_si512(va, vb));
+    }
+#elif defined(__AVX2__)
+    for (; ii + 4 <= n_words; ii += 4){
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + ii));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + ii));
+        _mm256_storeu_si256((__m256i *)(dst + ii), _mm256_and_si256(va, vb));
+    }
+#endif
+    for (; ii < n_words; ii++){
+        dst[ii] = a[ii] & b[ii];
+    }
+}
+
+void df_bits_andnot(uint64_t *dst, const uint64_t *a, const uint64_t *b, int n_words){
+    int ii = 0;
+#if defined(__AVX512F__)
+    for (; ii + 8 <= n_words; ii += 8){
+        __m512i va = _mm512_loadu_si512((const void *)(a + ii));
+        __m512i vb = _mm512_loadu_si512((const void *)(b + ii));
+        _mm512_storeu_si512((void *)(dst + ii), _mm512_andnot_si512(vb, va));    //andnot(x,y) = ~x & y
+    }
+#elif defined(__AVX2__)
+    for (; ii + 4 <= n_words; ii += 4){
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + ii));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + ii));
+        _mm256_storeu_si256((__m256i *)(dst + ii), _mm256_andnot_si256(vb, va));
+    }
+#endif
+    for (; ii < n_words; ii++){
+        dst[ii] = a[ii] & ~b[ii];
+    }
+}
+
+int df_bits_popcount(const uint64_t *a, int n_words){
+    int ii = 0;
+    int total = 0;
+#if defined(__AVX512VPOPCNTDQ__)
+    __m512i acc = _mm512_setzero_si512();
+    for (; ii + 8 <= n_words; ii += 8){
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512((const void *)(a + ii))));
+    }
+    total = (int)_mm512_reduce_add_epi64(acc);
+#endif
+    //without VPOPCNTDQ this is one popcnt instruction per word if the target has it
+    for (; ii < n_words; ii++){
+        total += __builtin_popcountll(a[ii]);
+    }
+    return total;
+}
+
+int df_bits_select(const uint64_t *a, int n_words, int k){
+    /*
+    Skip whole words by their popcount, then find the bit inside the word.
+    */
+    int ii, in_word;
+    uint64_t word;
+
+    if (k < 0){
+        return -1;
+    }
+    for (ii = 0; ii < n_words; ii++){
+        in_word = __builtin_popcountll(a[ii]);
+        if (k < in_word){
+            word = a[ii];
+#if defined(__BMI2__)
+            //deposit a single bit at the k-th set position of word
+            return ii * 64 + __builtin_ctzll(_pdep_u64((uint64_t)1 << k, word));
+#else
+            for (; k > 0; k--){
+                word &= word - 1;   //drop the lowest set bit
+            }
+            return ii * 64 + __builtin_ctzll(word);
+#endif
+        }
+        k -= in_word;
+    }
+    return -1;
+}
+
+void df_bits_to_vector(const uint64_t *a, int n_words, std::vector<int> &out){
+    uint64_t word;
+    for (int ii = 0; ii < n_words; ii++){
+        word = a[ii];
+        while (word != 0){
+            out.push_back(ii * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+}
+
+void df_bits_clear_range(uint64_t *a, int first, int last){
+    for (int bit = first; bit < last; ){
+        if ((bit & 63) == 0 && bit + 64 <= last){
+            a[bit >> 6] = 0;
+            bit += 64;
+        }else{
+            a[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+            bit++;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef _DF_BITSET_HPP_
+#define _DF_BITSET_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+Packed bitsets over router IDs, for the one-hop/two-hop neighbor sets.
+
+A set over N routers is (N + 63) / 64 uint64_t words, bit n of the set is
+bit (n % 64) of word n / 64. The df_bits_*() functions work on raw word
+arrays so they can be used on a row of a DFBitsetTable or on a scratch
+buffer alike. n_words is the length of all the arrays passed.
+
+The bulk operations use AVX-512 or AVX2 when the compiler targets them
+(e.g. -march=native in the Booksim Makefile), scalar code otherwise.
+Results are the same either way.
+*/
+
+void df_bits_or(uint64_t *dst, const uint64_t *a, const uint64_t *b, int n_words);       //dst = a | b
+void df_bits_and(uint64_t *dst, const uint64_t *a, const uint64_t *b, int n_words);      //dst = a & b
+void df_bits_andnot(uint64_t *dst, const uint64_t *a, const uint64_t *b, int n_words);   //dst = a & ~b
+int df_bits_popcount(const uint64_t *a, int n_words);
+int df_bits_select(const uint64_t *a, int n_words, int k);     //index of the k-th (from 0) set bit, -1 if fewer
+void df_bits_to_vector(const uint64_t *a, int n_words, std::vector<int> &out);      //appends the set bits, ascending
+void df_bits_clear_range(uint64_t *a, int first, int last);    //clears bits [first, last)
+
+inline void df_bits_set(uint64_t *a, int bit) { a[bit >> 6] |= (uint64_t)1 << (bit & 63); }
+inline bool df_bits_test(const uint64_t *a, int bit) { return (a[bit >> 6] >> (bit & 63)) & 1; }
+
+/*
+num_rows bitsets of num_bits bits each, back to back in one buffer.
+Filled with set() after reset(), or a read-only view of a buffer kept
+elsewhere (a mapped snapshot), set with view().
+*/
+class DFBitsetTable {
+    int _num_rows;
+    int _words;
+    std::vector<uint64_t> _bits;
+    const uint64_t *_data;
+
+public:
+    DFBitsetTable() : _num_rows(0), _words(0), _data(NULL) {}
+
+    void reset(int num_rows, int num_bits){
+        _num_rows = num_rows;
+        _words = (num_bits + 63) / 64;
+        _bits.assign((std::size_t)num_rows * _words, 0);
+        _data = _bits.data();
+    }
+
+    //bits must outlive the table
+    void view(int num_rows, int num_bits, const uint64_t *bits){
+        _num_rows = num_rows;
+        _words = (num_bits + 63) / 64;
+        std::vector<uint64_t>().swap(_bits);
+        _data = bits;
+    }
+
+    inline int words() const { return _words; }
+    inline const uint64_t * data() const { return _data; }
+    inline std::size_t bytes() const { return (std::size_t)_num_rows * _words * sizeof(uint64_t); }
+    inline const uint64_t * row(int r) const { return _data + (std::size_t)r * _words; }
+
+    inline void set(int r, int bit) { df_bits_set(_bits.data() + (std::size_t)r * _words, bit); }
+    inline bool test(int r, int bit) const { return df_bits_test(row(r), bit); }
+    inline int count(int r) const { return df_bits_popcount(row(r), _words); }
+};
+
+#endif
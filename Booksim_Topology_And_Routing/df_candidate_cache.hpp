@@ -0,0 +1,107 @@
+#ifndef _DF_CANDIDATE_CACHE_HPP_
+#define _DF_CANDIDATE_CACHE_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+Per (src_router, dst_router) list of candidate routers, filled lazily.
+
+The restricted VLB/UGAL modes pick the i-node from a candidate list that only
+depends on the router pair. So the list is built the first time a pair is
+asked for and then kept. Lists are appended to one pool, and every pair keeps
+where its list starts and how long it is:
+    _start: num_nodes * num_nodes entries, DF_CANDIDATES_NOT_BUILT until filled
+    _count: no of candidates of the pair
+    _pool:  all the filled lists back to back, 16-bit router IDs
+
+The two per-pair arrays are only allocated on first use, so the modes not in
+use cost nothing. The order of a list is kept as given to insert().
+
+The per-pair arrays plus the pool stay within the budget given to reset(), and
+_start stays below DF_CANDIDATES_NOT_BUILT. A list that doesn't fit is not kept.
+insert() hands it back from a scratch buffer and the pair is built again the
+next time. A list never has more than 65535 routers, DFPath's limit, so it
+fits in _count.
+*/
+
+#define DF_CANDIDATES_NOT_BUILT 0xFFFFFFFF
+
+struct DFCandidateView {
+    int count;
+    const uint16_t *nodes;      //good until the next insert() on the same cache
+};
+
+class DFCandidateCache {
+    int _num_nodes;
+    std::vector<uint32_t> _start;
+    std::vector<uint16_t> _count;
+    std::vector<uint16_t> _pool;
+    std::vector<uint16_t> _scratch;     //the last list that didn't fit
+    std::size_t _budget;                //bytes
+    std::size_t _num_not_kept;
+
+    inline std::size_t _cell(int src, int dst) const {
+        return (std::size_t)src * _num_nodes + dst;
+    }
+
+public:
+    DFCandidateCache() : _num_nodes(0), _budget(0), _num_not_kept(0) {}
+
+    void reset(int num_nodes, std::size_t budget){
+        _num_nodes = num_nodes;
+        _budget = budget;
+        _num_not_kept = 0;
+        std::vector<uint32_t>().swap(_start);
+        std::vector<uint16_t>().swap(_count);
+        std::vector<uint16_t>().swap(_pool);
+        std::vector<uint16_t>().swap(_scratch);
+    }
+
+    inline bool built(int src, int dst) const {
+        return !_start.empty() && _start[_cell(src, dst)] != DF_CANDIDATES_NOT_BUILT;
+    }
+
+    inline DFCandidateView get(int src, int dst) const {
+        std::size_t c = _cell(src, dst);
+        DFCandidateView view;
+        view.count = _count[c];
+        view.nodes = _pool.data() + _start[c];
+        return view;
+    }
+
+    template <typename Container>
+    DFCandidateView insert(int src, int dst, const Container &nodes){
+        std::size_t cells = (std::size_t)_num_nodes * _num_nodes;
+        std::size_t pool_size = _pool.size() + nodes.size();
+        if ((pool_size >= DF_CANDIDATES_NOT_BUILT) || (cells * (sizeof(uint32_t) + sizeof(uint16_t)) + pool_size * sizeof(uint16_t) > _budget)){
+            _num_not_kept += 1;
+            _scratch.assign(nodes.begin(), nodes.end());
+            DFCandidateView view;
+            view.count = _scratch.size();
+            view.nodes = _scratch.data();
+            return view;
+        }
+        if (_start.empty()){
+            _start.assign((std::size_t)_num_nodes * _num_nodes, DF_CANDIDATES_NOT_BUILT);
+            _count.assign((std::size_t)_num_nodes * _num_nodes, 0);
+        }
+        std::size_t c = _cell(src, dst);
+        _start[c] = _pool.size();
+        _count[c] = nodes.size();
+        for (auto it = nodes.begin(); it != nodes.end(); it++){
+            _pool.push_back((uint16_t)*it);
+        }
+        return get(src, dst);
+    }
+
+    inline std::size_t bytes() const {
+        return _start.size() * sizeof(uint32_t) + _count.size() * sizeof(uint16_t) + _pool.capacity() * sizeof(uint16_t);
+    }
+
+    //lists insert() could not keep, see above
+    inline std::size_t num_not_kept() const { return _num_not_kept; }
+};
+
+#endif
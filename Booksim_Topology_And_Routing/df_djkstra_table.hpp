@@ -0,0 +1,108 @@
+#ifndef _DF_DJKSTRA_TABLE_HPP_
+#define _DF_DJKSTRA_TABLE_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "df_array.hpp"
+
+/*
+All-pair djkstra results in flat arrays, filled by all_pair_djkstra().
+
+For num_rows source routers and num_nodes destinations, cell (src,dst) is
+src * num_nodes + dst:
+    distance:       one byte per cell. Dragonfly distances are a handful of
+                    link weights, DF_DJKSTRA_INF_DISTANCE marks unreachable.
+    parent_offsets: num_rows * num_nodes + 1 entries. The parents of cell c are
+                    parents[parent_offsets[c] .. parent_offsets[c+1]).
+    parents:        one pool for all cells, 16-bit router IDs. The src itself has
+                    the single parent DF_DJKSTRA_NO_PARENT, which parent() gives
+                    back as -1 (the path terminator generate_path() looks for).
+    path_counts:    no of shortest paths of every cell (1 for src to itself,
+                    0 if unreachable). Lets sample_path() pick a path uniformly
+                    at random without enumerating them.
+
+So the whole table is four allocations instead of num_rows * num_nodes small
+vectors. The arrays are read-only once built, and can also be views into a
+mapped snapshot.
+*/
+
+#define DF_DJKSTRA_INF_DISTANCE 255
+#define DF_DJKSTRA_NO_PARENT 0xFFFF
+
+class DFDjkstraTable {
+public:
+    int num_rows;
+    int num_nodes;
+    DFArray<uint8_t> distance;
+    DFArray<uint32_t> parent_offsets;
+    DFArray<uint16_t> parents;
+    DFArray<uint32_t> path_counts;
+
+    DFDjkstraTable() : num_rows(0), num_nodes(0) {}
+
+    inline std::size_t cell(int src, int dst) const {
+        return (std::size_t)src * num_nodes + dst;
+    }
+
+    inline int dist(int src, int dst) const { return distance[cell(src, dst)]; }
+
+    inline int parent_count(int src, int dst) const {
+        std::size_t c = cell(src, dst);
+        return parent_offsets[c + 1] - parent_offsets[c];
+    }
+
+    inline int parent(int src, int dst, int ii) const {
+        uint16_t p = parents[parent_offsets[cell(src, dst)] + ii];
+        return p == DF_DJKSTRA_NO_PARENT ? -1 : p;
+    }
+
+    inline uint32_t path_count(int src, int dst) const { return path_counts[cell(src, dst)]; }
+
+    template <typename Rng>
+    inline int sample_path(int src, int dst, Rng random_int, uint16_t *path) const {
+        /*
+        Walk from dst back to src, at each router going to parent p with
+        probability path_count(src,p) / path_count(src,router). Every shortest
+        path comes out with the same probability 1/path_count(src,dst).
+
+        random_int(max) must give a uniform integer in [0,max].
+        path must have room for the longest path. Gets src .. dst.
+        Returns the no of routers in the path, 0 if dst is unreachable.
+        */
+        uint16_t reversed[256];
+        int len = 0;
+        int current = dst;
+
+        if (path_count(src, dst) == 0){
+            return 0;
+        }
+
+        while (true){
+            reversed[len++] = (uint16_t)current;
+            if (current == src){
+                break;
+            }
+            std::size_t c = cell(src, current);
+            uint32_t pick = path_counts[c] > 1 ? random_int(path_counts[c] - 1) : 0;
+            uint32_t first = parent_offsets[c], last = parent_offsets[c + 1];
+            uint32_t ii;
+            for (ii = first; ii < last - 1; ii++){
+                uint32_t weight = path_counts[cell(src, parents[ii])];
+                if (pick < weight){
+                    break;
+                }
+                pick -= weight;
+            }
+            current = parents[ii];
+        }
+
+        for (int ii = 0; ii < len; ii++){
+            path[ii] = reversed[len - 1 - ii];
+        }
+        return len;
+    }
+};
+
+#endif
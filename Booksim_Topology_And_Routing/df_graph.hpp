@@ -0,0 +1,90 @@
+#ifndef _DF_GRAPH_HPP_
+#define _DF_GRAPH_HPP_
+
+#include <vector>
+
+/*
+Router graph in compressed-sparse-row form.
+
+All the out-links of router n are edges[offsets[n] .. offsets[n+1]), one record
+per neighbor, stored back to back in a single buffer:
+    dst:        the neighbor router
+    weight:     link type, LOCAL_LINK_WEIGHT or GLOBAL_LINK_WEIGHT (used by djkstra)
+    width:      no of parallel channels to dst
+    first_port: first output port at n going to dst. The ports are
+                [first_port, first_port + width - 1].
+
+Building: call add_edge() for every link in any order, then finalize().
+finalize() buckets the links by source with a stable counting sort, so the
+order in which the links of one router were added is kept.
+For the dragonfly that means the a-1 local links come first in every row,
+then the global links.
+*/
+
+struct DFEdge {
+    int dst;
+    int weight;
+    int width;
+    int first_port;
+};
+
+class DFGraph {
+    std::vector<int> _staged_src;
+    std::vector<DFEdge> _staged_edges;
+
+public:
+    int num_nodes;
+    std::vector<int> offsets;      //num_nodes + 1 entries
+    std::vector<DFEdge> edges;
+
+    DFGraph() : num_nodes(0) {}
+
+    void reset(int N){
+        num_nodes = N;
+        offsets.assign(N + 1, 0);
+        edges.clear();
+        _staged_src.clear();
+        _staged_edges.clear();
+    }
+
+    void add_edge(int src, int dst, int weight, int width){
+        DFEdge edge;
+        edge.dst = dst;
+        edge.weight = weight;
+        edge.width = width;
+        edge.first_port = -1;   //filled in by whoever lays out the ports
+        _staged_src.push_back(src);
+        _staged_edges.push_back(edge);
+    }
+
+    void finalize(){
+        std::size_t ii;
+        int node;
+
+        offsets.assign(num_nodes + 1, 0);
+        for (ii = 0; ii < _staged_src.size(); ii++){
+            offsets[_staged_src[ii] + 1] += 1;
+        }
+        for (node = 0; node < num_nodes; node++){
+            offsets[node + 1] += offsets[node];
+        }
+
+        std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+        edges.resize(_staged_edges.size());
+        for (ii = 0; ii < _staged_src.size(); ii++){
+            edges[fill[_staged_src[ii]]++] = _staged_edges[ii];
+        }
+
+        //staging buffers are not needed anymore
+        std::vector<int>().swap(_staged_src);
+        std::vector<DFEdge>().swap(_staged_edges);
+    }
+
+    inline int degree(int node) const { return offsets[node + 1] - offsets[node]; }
+    inline const DFEdge * begin(int node) const { return edges.data() + offsets[node]; }
+    inline const DFEdge * end(int node) const { return edges.data() + offsets[node + 1]; }
+    inline DFEdge * begin(int node) { return edges.data() + offsets[node]; }
+    inline DFEdge * end(int node) { return edges.data() + offsets[node + 1]; }
+};
+
+#endif
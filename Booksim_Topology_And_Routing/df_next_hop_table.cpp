@@ -0,0 +1,95 @@
+/*
+Builder of the per-hop next-hop table. See df_next_hop_table.hpp.
+*/
+
+#include <iostream>
+#include <cstdlib>
+
+#include "df_next_hop_table.hpp"
+
+using namespace std;
+
+void DFNextHopTable :: build(const DFGraph &graph, const DFDjkstraTable &djkstra_table, int shift){
+    /*
+    Masks first: a neighbor n is a next hop if it is one link closer, which only
+    needs the distances. Rows of n past num_rows are looked up shifted, same
+    as select_shortest_path_djkstra() does.
+
+    Then the hops. Every next hop is strictly closer to tgt (weights are > 0),
+    so going through the cells by increasing distance, the hops of all the
+    next hops are known when a cell is reached. Cells are bucketed by distance
+    with a counting sort.
+    */
+    int N = graph.num_nodes;
+    int rows = djkstra_table.num_rows;
+    int cur, tgt, n_shift, dist, ii;
+    std::size_t c;
+
+    for (cur = 0; cur < N; cur++){
+        if (graph.degree(cur) > DF_NEXT_HOP_MAX_DEGREE){
+            cout << "Error! Per-hop routing supports at most " << DF_NEXT_HOP_MAX_DEGREE << " neighbors per router, router " << cur << " has " << graph.degree(cur) << " . Exiting." << endl;
+            exit(-1);
+        }
+    }
+
+    _num_rows = rows;
+    _num_nodes = N;
+    _shift = shift;
+    _masks.assign((std::size_t)rows * N, 0);
+    _hops.assign((std::size_t)rows * N, DF_DJKSTRA_INF_DISTANCE);
+
+    std::vector<uint32_t> bucket_start(DF_DJKSTRA_INF_DISTANCE + 2, 0);
+
+    for (cur = 0; cur < rows; cur++){
+        for (tgt = 0; tgt < N; tgt++){
+            c = _cell(cur, tgt);
+            dist = djkstra_table.distance[c];
+            bucket_start[dist + 1] += 1;
+
+            if ((cur == tgt) || (dist == DF_DJKSTRA_INF_DISTANCE)){
+                continue;
+            }
+
+            ii = 0;
+            for (const DFEdge *edge = graph.begin(cur); edge != graph.end(cur); edge++, ii++){
+                n_shift = (edge->dst / shift) * shift;
+                if (edge->weight + djkstra_table.dist(edge->dst - n_shift, (tgt - n_shift + N) % N) == dist){
+                    _masks[c] |= (uint64_t)1 << ii;
+                }
+            }
+        }
+    }
+
+    for (dist = 0; dist <= DF_DJKSTRA_INF_DISTANCE; dist++){
+        bucket_start[dist + 1] += bucket_start[dist];
+    }
+    std::vector<uint32_t> order(bucket_start.back());
+    for (c = 0; c < order.size(); c++){
+        order[bucket_start[djkstra_table.distance[c]]++] = (uint32_t)c;
+    }
+
+    for (std::size_t kk = 0; kk < order.size(); kk++){
+        c = order[kk];
+        cur = (int)(c / N);
+        tgt = (int)(c % N);
+
+        if (cur == tgt){
+            _hops[c] = 0;
+            continue;
+        }
+
+        uint64_t mask = _masks[c];
+        int best = DF_DJKSTRA_INF_DISTANCE;
+        while (mask != 0){
+            ii = __builtin_ctzll(mask);
+            mask &= mask - 1;
+            int next = graph.begin(cur)[ii].dst;
+            n_shift = (next / shift) * shift;
+            int next_hops = _hops[_cell(next - n_shift, (tgt - n_shift + N) % N)];
+            if (next_hops + 1 < best){
+                best = next_hops + 1;
+            }
+        }
+        _hops[c] = (uint8_t)best;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef _DF_NEXT_HOP_TABLE_HPP_
+#define _DF_NEXT_HOP_TABLE_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "df_graph.hpp"
+#include "df_djkstra_table.hpp"
+
+/*
+Next hops of every (current_router, target_router) pair, for the *_perhop
+routing functions. Built once from the djkstra distances.
+
+Cell (cur,tgt) is cur * num_nodes + tgt:
+    masks:  bit k is set if the k-th edge of g_graph row cur starts a
+            djkstra shortest path to tgt, i.e.
+            weight(cur,n) + dist(n,tgt) == dist(cur,tgt) for n = edge k's dst.
+            Rows are at most DF_NEXT_HOP_MAX_DEGREE edges long.
+    hops:   no of hops of the shortest (in hops) of those paths.
+            UGAL_L pathlen_based compares with it.
+
+Like g_djkstra_table, only the first num_rows routers have rows. Row cur for
+cur >= num_rows is row (cur - shift) with every router renamed by +shift (mod
+num_nodes), shift being a multiple of the group-shift period. The edge indices
+of the bits are then edges of row (cur - shift), and their dst moves by +shift.
+*/
+
+#define DF_NEXT_HOP_MAX_DEGREE 64
+
+class DFNextHopTable {
+    int _num_rows;
+    int _num_nodes;
+    int _shift;
+    std::vector<uint64_t> _masks;
+    std::vector<uint8_t> _hops;
+
+    inline std::size_t _cell(int cur, int tgt) const {
+        return (std::size_t)cur * _num_nodes + tgt;
+    }
+
+public:
+    DFNextHopTable() : _num_rows(0), _num_nodes(0), _shift(1) {}
+
+    //shift is g_djkstra_shift. Exits if a router has more than DF_NEXT_HOP_MAX_DEGREE neighbors.
+    void build(const DFGraph &graph, const DFDjkstraTable &djkstra_table, int shift);
+
+    inline bool built() const { return _num_rows > 0; }
+
+    inline int hops(int cur, int tgt) const {
+        int shift = (cur / _shift) * _shift;
+        return _hops[_cell(cur - shift, (tgt - shift + _num_nodes) % _num_nodes)];
+    }
+
+    template <typename Rng>
+    inline int next_router(const DFGraph &graph, int cur, int tgt, Rng random_int) const {
+        /*
+        One of the next hops of (cur,tgt), uniformly at random.
+        random_int(max) must give a uniform integer in [0,max].
+        cur != tgt.
+        */
+        int shift = (cur / _shift) * _shift;
+        int row = cur - shift;
+        uint64_t mask = _masks[_cell(row, (tgt - shift + _num_nodes) % _num_nodes)];
+        int count = __builtin_popcountll(mask);
+
+        for (int pick = count > 1 ? random_int(count - 1) : 0; pick > 0; pick--){
+            mask &= mask - 1;   //drop the lowest set bit
+        }
+        return (graph.begin(row)[__builtin_ctzll(mask)].dst + shift) % _num_nodes;
+    }
+
+    inline std::size_t bytes() const {
+        return _masks.size() * sizeof(uint64_t) + _hops.size() * sizeof(uint8_t);
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _DF_PATH_HPP_
+#define _DF_PATH_HPP_
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <initializer_list>
+
+/*
+Fixed-capacity source route for the dragonfly routing functions.
+
+The longest path any of the routing functions build at the source is a 
+6 hop VLB path (7 routers). PAR re-evaluation keeps the routers already
+visited in front of the new path, so a few more slots are kept for that.
+par_take_new_path() refuses paths that do not fit. Router IDs are kept as 
+16-bit values, _setGlobals() refuses networks with more routers than that.
+
+Everything is inline and trivially copyable, so building, joining and copying
+a path at the source router does not touch the heap. The interface is the
+subset of std::vector<int> the routing code uses (size, [], push_back,
+begin/end, assign), so the code reads the same as before.
+*/
+
+#define DF_MAX_PATH_ROUTERS 12
+
+class DFPath {
+    uint16_t _routers[DF_MAX_PATH_ROUTERS];
+    uint8_t _len;
+
+    static void _overflow(){
+        std::cout << "Error! Path longer than DF_MAX_PATH_ROUTERS (" << DF_MAX_PATH_ROUTERS << ") routers. Exiting." << std::endl;
+        exit(-1);
+    }
+
+public:
+    typedef uint16_t value_type;
+    typedef const uint16_t * const_iterator;
+
+    DFPath() : _len(0) {}
+
+    DFPath(std::initializer_list<int> routers) : _len(0) {
+        for (auto it = routers.begin(); it != routers.end(); it++){
+            push_back(*it);
+        }
+    }
+
+    inline std::size_t size() const { return _len; }
+    inline bool empty() const { return _len == 0; }
+    inline void clear() { _len = 0; }
+    inline void reserve(std::size_t) {}   //kept so vector-style code still compiles. Capacity is fixed.
+
+    inline int operator[](std::size_t ii) const { return _routers[ii]; }
+    inline int front() const { return _routers[0]; }
+    inline int back() const { return _routers[_len - 1]; }
+
+    inline const_iterator begin() const { return _routers; }
+    inline const_iterator end() const { return _routers + _len; }
+
+    inline void push_back(int router){
+        if (_len >= DF_MAX_PATH_ROUTERS){
+            _overflow();
+        }
+        _routers[_len++] = (uint16_t)router;
+    }
+
+    template <typename Iter>
+    inline void assign(Iter first, Iter last){
+        _len = 0;
+        for (; first != last; first++){
+            push_back(*first);
+        }
+    }
+
+    inline void join(const DFPath &first_half, const DFPath &second_half){
+        /*
+        this = first_half + second_half, the router shared by the two halves
+        (last of first_half, first of second_half) is kept only once.
+        */
+        if (first_half._len + second_half._len - 1 > DF_MAX_PATH_ROUTERS){
+            _overflow();
+        }
+        int ii;
+        _len = 0;
+        for (ii = 0; ii < first_half._len; ii++){
+            _routers[_len++] = first_half._routers[ii];
+        }
+        for (ii = 1; ii < second_half._len; ii++){
+            _routers[_len++] = second_half._routers[ii];
+        }
+    }
+};
+
+#endif
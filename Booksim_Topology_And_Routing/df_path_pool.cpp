@@ -0,0 +1,155 @@
+/*
+Precomputed djkstra minimal path pool. See df_path_pool.hpp.
+*/
+
+#include <iostream>
+#include <cstdlib>
+
+#include "df_path_pool.hpp"
+#include "djkstra.hpp"
+
+using namespace std;
+
+void DFPathPool :: _Enumerate(int src, int dst, std::vector<uint32_t> &offsets, std::vector<uint16_t> &routers) const {
+    /*
+    Append the paths of (src,dst) to routers, one offset per path end.
+    offsets must already hold the start of the first path.
+    */
+    std::vector< std::vector<int> > final_paths;
+    generate_path(src, dst, *_table, final_paths);
+
+    for (std::size_t ii = 0; ii < final_paths.size(); ii++){
+        for (std::size_t jj = 0; jj < final_paths[ii].size(); jj++){
+            routers.push_back((uint16_t)final_paths[ii][jj]);
+        }
+        offsets.push_back(routers.size());
+    }
+}
+
+std::size_t DFPathPool :: _EntryBytes(const _CacheEntry &entry){
+    //payload plus a rough guess for the list node, the hash map node and the vector headers
+    return entry.offsets.capacity() * sizeof(uint32_t) + entry.routers.capacity() * sizeof(uint16_t) + sizeof(_CacheEntry) + 64;
+}
+
+void DFPathPool :: _Reset(const DFDjkstraTable &table, std::size_t budget_bytes){
+    _table = &table;
+    _budget_bytes = budget_bytes;
+    _full = false;
+
+    _cell_offsets.clear();
+    _path_offsets.clear();
+    _routers.clear();
+    _cache.clear();
+    _cache_index.clear();
+    _cache_bytes = 0;
+}
+
+void DFPathPool :: build(const DFDjkstraTable &table, std::size_t budget_bytes){
+    _Reset(table, budget_bytes);
+
+    std::size_t num_cells = (std::size_t)table.num_rows * table.num_nodes;
+    std::size_t pool_bytes = (num_cells + 1) * sizeof(uint32_t);
+
+    if (pool_bytes > _budget_bytes){
+        cout << "djkstra path pool: cell offsets alone need " << pool_bytes << " bytes, more than the budget of "
+            << _budget_bytes << ". Using the LRU cache." << endl;
+        return;
+    }
+
+    std::vector<uint32_t> cell_offsets, path_offsets;
+    std::vector<uint16_t> routers;
+
+    cell_offsets.reserve(num_cells + 1);
+    cell_offsets.push_back(0);
+    path_offsets.push_back(0);
+
+    for (int src = 0; src < table.num_rows; src++){
+        for (int dst = 0; dst < table.num_nodes; dst++){
+            _Enumerate(src, dst, path_offsets, routers);
+
+            if (path_offsets.size() - 1 > UINT32_MAX || routers.size() > UINT32_MAX){
+                pool_bytes = (std::size_t)-1;   //offsets can't hold it, same as over budget
+            }else{
+                pool_bytes = (num_cells + 1) * sizeof(uint32_t) + path_offsets.size() * sizeof(uint32_t) + routers.size() * sizeof(uint16_t);
+            }
+
+            if (pool_bytes > _budget_bytes){
+                cout << "djkstra path pool: over the budget of " << _budget_bytes << " bytes at router " << src
+                    << " of " << table.num_rows << ". Using the LRU cache." << endl;
+                return;
+            }
+
+            cell_offsets.push_back(path_offsets.size() - 1);
+        }
+    }
+
+    path_offsets.shrink_to_fit();
+    routers.shrink_to_fit();
+
+    _cell_offsets.own(cell_offsets);
+    _path_offsets.own(path_offsets);
+    _routers.own(routers);
+    _full = true;
+    cout << "djkstra path pool: " << _path_offsets.size() - 1 << " paths, " << bytes() << " bytes." << endl;
+}
+
+void DFPathPool :: use_cache(const DFDjkstraTable &table, std::size_t budget_bytes){
+    _Reset(table, budget_bytes);
+}
+
+void DFPathPool :: view(const DFDjkstraTable &table, std::size_t budget_bytes, const uint32_t *cell_offsets, 
+                        const uint32_t *path_offsets, std::size_t num_paths, const uint16_t *routers, std::size_t num_routers){
+    _Reset(table, budget_bytes);
+
+    _cell_offsets.view(cell_offsets, (std::size_t)table.num_rows * table.num_nodes + 1);
+    _path_offsets.view(path_offsets, num_paths + 1);
+    _routers.view(routers, num_routers);
+    _full = true;
+}
+
+DFPathPoolView DFPathPool :: lookup(int src, int dst){
+    DFPathPoolView view;
+    std::size_t cell = _table->cell(src, dst);
+
+    if (_full){
+        view.count = _cell_offsets[cell + 1] - _cell_offsets[cell];
+        view.offsets = _path_offsets.data() + _cell_offsets[cell];
+        view.routers = _routers.data();
+        return view;
+    }
+
+    auto found = _cache_index.find(cell);
+    if (found != _cache_index.end()){
+        //hit. move it to the front.
+        _cache.splice(_cache.begin(), _cache, found->second);
+    }else{
+        //miss. enumerate, put it in front and drop from the back until we are in budget again.
+        _cache.push_front(_CacheEntry());
+        _CacheEntry &entry = _cache.front();
+        entry.cell = cell;
+        entry.offsets.push_back(0);
+        _Enumerate(src, dst, entry.offsets, entry.routers);
+
+        _cache_index[cell] = _cache.begin();
+        _cache_bytes += _EntryBytes(entry);
+
+        while (_cache_bytes > _budget_bytes && _cache.size() > 1){
+            _cache_bytes -= _EntryBytes(_cache.back());
+            _cache_index.erase(_cache.back().cell);
+            _cache.pop_back();
+        }
+    }
+
+    const _CacheEntry &entry = _cache.front();
+    view.count = entry.offsets.size() - 1;
+    view.offsets = entry.offsets.data();
+    view.routers = entry.routers.data();
+    return view;
+}
+
+std::size_t DFPathPool :: bytes() const {
+    if (_full){
+        return _cell_offsets.size() * sizeof(uint32_t) + _path_offsets.size() * sizeof(uint32_t) + _routers.size() * sizeof(uint16_t);
+    }
+    return _cache_bytes;
+}
@@ -0,0 +1,95 @@
+#ifndef _DF_PATH_POOL_HPP_
+#define _DF_PATH_POOL_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include "df_array.hpp"
+#include "df_djkstra_table.hpp"
+
+/*
+All the djkstra minimal paths of every (src,dst) router pair, enumerated once
+so the routing functions only have to pick one.
+
+Full pool: every pair of the djkstra table, packed in three arrays.
+    cell_offsets:   num_rows * num_nodes + 1 entries. The paths of cell
+                    (src,dst) are path no cell_offsets[c] .. cell_offsets[c+1]-1.
+    path_offsets:   one entry per path + 1. Path p is
+                    routers[path_offsets[p] .. path_offsets[p+1]).
+    routers:        all the paths back to back, src first, dst last.
+
+If the full pool would not fit in the memory budget given to build(), nothing
+is enumerated up front. lookup() then enumerates a pair the first time it
+is asked for and keeps it in an LRU cache, dropping the least recently used
+pairs once the cache goes over the budget.
+
+The paths of a pair are in the same order generate_path() gives them, so
+picking path RandomInt(count-1) chooses the same path as before.
+*/
+
+struct DFPathPoolView {
+    int count;                  //no of paths
+    const uint32_t *offsets;    //count + 1 entries into routers
+    const uint16_t *routers;
+
+    inline int length(int ii) const { return offsets[ii + 1] - offsets[ii]; }
+    inline const uint16_t * path(int ii) const { return routers + offsets[ii]; }
+};
+
+class DFPathPool {
+    struct _CacheEntry {
+        std::size_t cell;
+        std::vector<uint32_t> offsets;
+        std::vector<uint16_t> routers;
+    };
+
+    const DFDjkstraTable *_table;
+    std::size_t _budget_bytes;
+    bool _full;
+
+    DFArray<uint32_t> _cell_offsets;
+    DFArray<uint32_t> _path_offsets;
+    DFArray<uint16_t> _routers;
+
+    //LRU cache, most recently used in front
+    std::list<_CacheEntry> _cache;
+    std::unordered_map<std::size_t, std::list<_CacheEntry>::iterator> _cache_index;
+    std::size_t _cache_bytes;
+
+    void _Reset(const DFDjkstraTable &table, std::size_t budget_bytes);
+    static std::size_t _EntryBytes(const _CacheEntry &entry);
+    void _Enumerate(int src, int dst, std::vector<uint32_t> &offsets, std::vector<uint16_t> &routers) const;
+
+public:
+    DFPathPool() : _table(NULL), _budget_bytes(0), _full(false), _cache_bytes(0) {}
+
+    //Enumerate all the paths of table if they fit in budget_bytes, otherwise
+    //set up the LRU cache with that budget. table must outlive the pool.
+    void build(const DFDjkstraTable &table, std::size_t budget_bytes);
+
+    //Skip the enumeration and go straight to the LRU cache, for when an
+    //earlier build() of the same table did not fit.
+    void use_cache(const DFDjkstraTable &table, std::size_t budget_bytes);
+
+    //Use the three arrays of an earlier full build(), e.g. out of a snapshot.
+    //They must outlive the pool.
+    void view(const DFDjkstraTable &table, std::size_t budget_bytes, const uint32_t *cell_offsets, 
+              const uint32_t *path_offsets, std::size_t num_paths, const uint16_t *routers, std::size_t num_routers);
+
+    //Paths of (src,dst), src < table.num_rows. The view is good until the
+    //next lookup() (a cache miss may evict it).
+    DFPathPoolView lookup(int src, int dst);
+
+    inline bool is_full() const { return _full; }
+
+    //the arrays of a full pool, empty otherwise
+    inline const DFArray<uint32_t> & cell_offsets() const { return _cell_offsets; }
+    inline const DFArray<uint32_t> & path_offsets() const { return _path_offsets; }
+    inline const DFArray<uint16_t> & routers() const { return _routers; }
+    std::size_t bytes() const;
+};
+
+#endif
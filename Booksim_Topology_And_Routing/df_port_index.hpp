@@ -0,0 +1,131 @@
+#ifndef _DF_PORT_INDEX_HPP_
+#define _DF_PORT_INDEX_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+#include "df_graph.hpp"
+
+/*
+Slot of a global neighbor in the router's g_graph row, in O(1).
+
+The global edges of router n are begin(n) + first_global + slot, slot < 255.
+Every router gets a small direct-mapped table of table_size cells, and the
+cell of a neighbor is the top bits of neighbor * multiplier[n]. build() picks
+the multiplier of each router so that its global neighbors land in distinct
+cells (a perfect hash, tried over a fixed sequence of odd multipliers, so the
+result is the same on every run). A lookup is one multiply, one shift and
+one byte load, whatever h or g is.
+
+A table per (router, group) would be N*g entries, and a router can have two
+global neighbors in the same group, so the key is the neighbor router.
+
+slot() of a router that is not a global neighbor is DF_NO_GLOBAL_SLOT or the
+slot of some other neighbor, the caller checks the edge's dst.
+*/
+
+#define DF_NO_GLOBAL_SLOT 0xFF
+#define DF_GLOBAL_SLOT_TRIES 4096
+
+class DFGlobalPortIndex {
+    int _table_size;                //power of two, at least 4x the most global edges of a router
+    int _shift;                     //32 - log2(_table_size)
+    std::vector<uint32_t> _multiplier;
+    std::vector<uint8_t> _slots;    //num_nodes * _table_size
+
+    static uint32_t _candidate_multiplier(int node, int attempt){
+        uint64_t key = ((uint64_t)(uint32_t)node << 32) | (uint32_t)attempt;
+
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+
+        return (uint32_t)key | 1;
+    }
+
+    inline uint32_t _cell(int neighbor, uint32_t multiplier) const {
+        return ((uint32_t)neighbor * multiplier) >> _shift;
+    }
+
+    //true if a multiplier that separates the global neighbors of node was found
+    bool _build_node(const DFGraph &graph, int node, int first_global){
+        const DFEdge *first = graph.begin(node) + first_global;
+        int count = graph.end(node) - first;
+        uint8_t *slots = _slots.data() + (std::size_t)node * _table_size;
+        int attempt, ii;
+
+        for (attempt = 0; attempt < DF_GLOBAL_SLOT_TRIES; attempt++){
+            uint32_t multiplier = _candidate_multiplier(node, attempt);
+
+            std::fill(slots, slots + _table_size, (uint8_t)DF_NO_GLOBAL_SLOT);
+            for (ii = 0; ii < count; ii++){
+                uint32_t cell = _cell(first[ii].dst, multiplier);
+                if (slots[cell] != DF_NO_GLOBAL_SLOT){
+                    break;
+                }
+                slots[cell] = (uint8_t)ii;
+            }
+
+            if (ii == count){
+                _multiplier[node] = multiplier;
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    DFGlobalPortIndex() : _table_size(0), _shift(32) {}
+
+    //graph must be finalized. The first first_global edges of every row are local.
+    void build(const DFGraph &graph, int first_global){
+        int node;
+        int max_global = 0;
+
+        for (node = 0; node < graph.num_nodes; node++){
+            max_global = std::max(max_global, graph.degree(node) - first_global);
+        }
+        if (max_global >= DF_NO_GLOBAL_SLOT){
+            std::cout << "Error! " << max_global << " global neighbors on one router, the port index holds at most " << DF_NO_GLOBAL_SLOT - 1 << " . Exiting." << std::endl;
+            exit(-1);
+        }
+
+        _table_size = 4;
+        _shift = 30;
+        while (_table_size < 4 * max_global){
+            _table_size *= 2;
+            _shift -= 1;
+        }
+
+        //a table this sparse almost never needs many tries. If some router runs out, double the tables.
+        while (true){
+            _multiplier.assign(graph.num_nodes, 0);
+            _slots.assign((std::size_t)graph.num_nodes * _table_size, DF_NO_GLOBAL_SLOT);
+
+            for (node = 0; node < graph.num_nodes; node++){
+                if (_build_node(graph, node, first_global) == false){
+                    break;
+                }
+            }
+            if (node == graph.num_nodes){
+                return;
+            }
+            _table_size *= 2;
+            _shift -= 1;
+        }
+    }
+
+    inline int slot(int node, int neighbor) const {
+        return _slots[(std::size_t)node * _table_size + _cell(neighbor, _multiplier[node])];
+    }
+
+    inline std::size_t bytes() const { return _multiplier.size() * sizeof(uint32_t) + _slots.size(); }
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+Writer and reader of the constructor snapshots. See df_snapshot.hpp.
+*/
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "df_snapshot.hpp"
+
+using namespace std;
+
+struct _DFSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_sections;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t topology_hash;
+};
+
+struct _DFSnapshotSection {
+    uint32_t id;
+    uint32_t element_size;
+    uint64_t offset;
+    uint64_t count;
+};
+
+static uint64_t _align(uint64_t offset){
+    return (offset + DF_SNAPSHOT_ALIGN - 1) / DF_SNAPSHOT_ALIGN * DF_SNAPSHOT_ALIGN;
+}
+
+uint64_t df_snapshot_key(const std::string &parameters){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t ii = 0; ii < parameters.size(); ii++){
+        hash ^= (unsigned char)parameters[ii];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int df_snapshot_lock(const std::string &file_name){
+    std::string lock_name = file_name + ".lock";
+    int fd = ::open(lock_name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0){
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0){
+        if (errno != EINTR){
+            ::close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+void df_snapshot_unlock(int lock){
+    if (lock >= 0){
+        flock(lock, LOCK_UN);
+        ::close(lock);
+    }
+}
+
+bool DFSnapshotWriter :: write(const std::string &file_name, uint64_t key, uint64_t topology_hash) const {
+    _DFSnapshotHeader header = {DF_SNAPSHOT_MAGIC, DF_SNAPSHOT_VERSION, (uint32_t)_sections.size(), 0, key, topology_hash};
+    std::vector<_DFSnapshotSection> table(_sections.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(_DFSnapshotSection);
+    std::size_t ii;
+
+    for (ii = 0; ii < _sections.size(); ii++){
+        offset = _align(offset);
+        table[ii].id = _sections[ii].id;
+        table[ii].element_size = _sections[ii].element_size;
+        table[ii].offset = offset;
+        table[ii].count = _sections[ii].count;
+        offset += _sections[ii].count * _sections[ii].element_size;
+    }
+
+    //pid in the name, in case two runs write the same snapshot at once
+    std::string temp_name = file_name + ".tmp." + std::to_string(getpid());
+    ofstream out(temp_name, ios::binary);
+    if (out.is_open() == false){
+        return false;
+    }
+
+    static const char padding[DF_SNAPSHOT_ALIGN] = {0};
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)table.data(), table.size() * sizeof(_DFSnapshotSection));
+    offset = sizeof(header) + table.size() * sizeof(_DFSnapshotSection);
+    for (ii = 0; ii < _sections.size(); ii++){
+        out.write(padding, table[ii].offset - offset);
+        out.write((const char *)_sections[ii].data, _sections[ii].count * _sections[ii].element_size);
+        offset = table[ii].offset + _sections[ii].count * _sections[ii].element_size;
+    }
+    out.close();
+
+    if (!out || (std::rename(temp_name.c_str(), file_name.c_str()) != 0)){
+        std::remove(temp_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool DFSnapshot :: open(const std::string &file_name, uint64_t key, uint64_t topology_hash, std::string &reason){
+    close();
+    reason.clear();
+
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0){
+        reason = "no such file";
+        return false;
+    }
+
+    struct stat file_stat;
+    if ((fstat(fd, &file_stat) != 0) || ((std::size_t)file_stat.st_size < sizeof(_DFSnapshotHeader))){
+        ::close(fd);
+        reason = "too short";
+        return false;
+    }
+
+    void *base = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);    //the mapping keeps the file
+    if (base == MAP_FAILED){
+        reason = std::string("mmap failed, ") + strerror(errno);
+        return false;
+    }
+    _base = base;
+    _bytes = file_stat.st_size;
+
+    const _DFSnapshotHeader *header = (const _DFSnapshotHeader *)_base;
+    if ((header->magic != DF_SNAPSHOT_MAGIC) || (header->version != DF_SNAPSHOT_VERSION)){
+        reason = "not a version " + std::to_string(DF_SNAPSHOT_VERSION) + " snapshot";
+    }
+    else if ((header->key != key) || (header->topology_hash != topology_hash)){
+        reason = "made for another topology";
+    }
+    else if (sizeof(_DFSnapshotHeader) + (uint64_t)header->num_sections * sizeof(_DFSnapshotSection) > _bytes){
+        reason = "truncated";
+    }
+    else{
+        const _DFSnapshotSection *table = (const _DFSnapshotSection *)(header + 1);
+        for (uint32_t ii = 0; ii < header->num_sections; ii++){
+            if ((table[ii].offset > _bytes) || (table[ii].count * table[ii].element_size > _bytes - table[ii].offset)){
+                reason = "truncated";
+                break;
+            }
+        }
+    }
+
+    if (reason.empty() == false){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void DFSnapshot :: close(){
+    if (_base != NULL){
+        munmap(_base, _bytes);
+    }
+    _base = NULL;
+    _bytes = 0;
+}
+
+const void * DFSnapshot :: _Find(uint32_t id, uint32_t element_size, std::size_t &count) const {
+    const _DFSnapshotHeader *header = (const _DFSnapshotHeader *)_base;
+    const _DFSnapshotSection *table = (const _DFSnapshotSection *)(header + 1);
+
+    count = 0;
+    if (_base == NULL){
+        return NULL;
+    }
+    for (uint32_t ii = 0; ii < header->num_sections; ii++){
+        if (table[ii].id == id){
+            if (table[ii].element_size != element_size){
+                return NULL;
+            }
+            count = table[ii].count;
+            return (const char *)_base + table[ii].offset;
+        }
+    }
+    return NULL;
+}
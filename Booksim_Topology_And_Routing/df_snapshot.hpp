@@ -0,0 +1,96 @@
+#ifndef _DF_SNAPSHOT_HPP_
+#define _DF_SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+Binary snapshot of the tables the DragonFlyFull constructor computes, so a
+later run with the same topology maps them instead of computing them again.
+
+File layout, all little endian as written by the host:
+    header:     magic, DF_SNAPSHOT_VERSION, no of sections, 0 (uint32 each),
+                key, topology hash (uint64 each).
+    sections:   one {id, element size (uint32), file offset, no of elements
+                (uint64)} record per section.
+    data:       the sections, each starting on a DF_SNAPSHOT_ALIGN boundary.
+
+key is df_snapshot_key() of the parameters the tables depend on, the
+topology hash is df_topology_hash() of the built graph. open() refuses a file
+if either differs, or if it was written by another snapshot version. Bump
+DF_SNAPSHOT_VERSION whenever a section changes meaning.
+
+The file is mapped read-only and shared, the sections are used in place.
+They only hold offsets, never pointers, so they work at any address, and
+all the processes that map one file share one physical copy. Put the files
+in /dev/shm to keep them in memory only. A snapshot that is replaced while
+mapped stays valid for whoever has it mapped, rename() keeps the old inode
+alive.
+*/
+
+#define DF_SNAPSHOT_MAGIC 0x4E534644       //"DFSN"
+#define DF_SNAPSHOT_VERSION 3
+#define DF_SNAPSHOT_ALIGN 64
+
+uint64_t df_snapshot_key(const std::string &parameters);    //64-bit FNV-1a
+
+//Blocks until this process holds the lock of file_name, an flock() on
+//file_name.lock. Returns the lock, -1 if the lock file can't be made
+//(then nothing is locked and the caller just goes on).
+int df_snapshot_lock(const std::string &file_name);
+void df_snapshot_unlock(int lock);
+
+class DFSnapshotWriter {
+    struct _Section {
+        uint32_t id;
+        uint32_t element_size;
+        const void *data;
+        uint64_t count;
+    };
+    std::vector<_Section> _sections;
+
+public:
+    //data is only read by write(), it must stay valid until then
+    template <typename T>
+    void add(uint32_t id, const T *data, std::size_t count){
+        _Section section = {id, (uint32_t)sizeof(T), data, count};
+        _sections.push_back(section);
+    }
+
+    //Writes a temporary file next to file_name and renames it over file_name,
+    //so readers never see half a snapshot. Returns false if that fails.
+    bool write(const std::string &file_name, uint64_t key, uint64_t topology_hash) const;
+};
+
+class DFSnapshot {
+    void *_base;
+    std::size_t _bytes;
+
+    DFSnapshot(const DFSnapshot &);
+    DFSnapshot & operator=(const DFSnapshot &);
+
+    const void * _Find(uint32_t id, uint32_t element_size, std::size_t &count) const;
+
+public:
+    DFSnapshot() : _base(NULL), _bytes(0) {}
+    ~DFSnapshot() { close(); }
+
+    //Maps file_name. Returns false, with the reason, if there is no such file
+    //or it is not a snapshot of this version for key and topology_hash.
+    bool open(const std::string &file_name, uint64_t key, uint64_t topology_hash, std::string &reason);
+    void close();
+
+    inline bool is_open() const { return _base != NULL; }
+    inline std::size_t bytes() const { return _bytes; }
+
+    //Elements of section id, NULL if there is no such section or its elements
+    //are not T sized.
+    template <typename T>
+    const T * section(uint32_t id, std::size_t &count) const {
+        return (const T *)_Find(id, sizeof(T), count);
+    }
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+Loader for the offline VLB i-node tables. See df_vlb_table.hpp.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+#include "df_vlb_table.hpp"
+
+using namespace std;
+
+static void _hash_word(uint64_t &hash, uint32_t word){
+    for (int ii = 0; ii < 4; ii++){
+        hash ^= (word >> (8 * ii)) & 0xFF;
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+uint64_t df_topology_hash(const DFGraph &graph){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    _hash_word(hash, graph.num_nodes);
+    for (int node = 0; node < graph.num_nodes; node++){
+        for (const DFEdge *edge = graph.begin(node); edge != graph.end(node); edge++){
+            _hash_word(hash, node);
+            _hash_word(hash, edge->dst);
+            _hash_word(hash, edge->weight);
+            _hash_word(hash, edge->width);
+        }
+    }
+    return hash;
+}
+
+void DFVlbTable :: load(const std::string &file_name, const DFGraph &graph){
+    uint32_t header[4];
+    uint64_t topology_hash;
+    int N = graph.num_nodes;
+
+    ifstream in(file_name, ios::binary);
+    if (in.is_open() == false){
+        cout << "Error! Can't open vlb_inode_table file " << file_name << " . Exiting." << endl;
+        exit(-1);
+    }
+
+    in.read((char *)header, sizeof(header));
+    in.read((char *)&topology_hash, sizeof(topology_hash));
+    if (!in || (header[0] != DF_VLB_TABLE_MAGIC) || (header[1] != DF_VLB_TABLE_VERSION)){
+        cout << "Error! " << file_name << " is not a version " << DF_VLB_TABLE_VERSION << " vlb i-node table. Exiting." << endl;
+        exit(-1);
+    }
+    if (((int)header[2] != N) || (topology_hash != df_topology_hash(graph))){
+        cout << "Error! " << file_name << " was made for another topology (" << header[2] << " routers). Regenerate it from df_topology_file. Exiting." << endl;
+        exit(-1);
+    }
+
+    _offsets.resize((std::size_t)N * N + 1);
+    in.read((char *)_offsets.data(), _offsets.size() * sizeof(uint32_t));
+    if (!in || (_offsets[0] != 0)){
+        cout << "Error! Truncated vlb_inode_table file " << file_name << " . Exiting." << endl;
+        exit(-1);
+    }
+    _nodes.resize(_offsets.back());
+    in.read((char *)_nodes.data(), _nodes.size() * sizeof(uint16_t));
+    if (!in){
+        cout << "Error! Truncated vlb_inode_table file " << file_name << " . Exiting." << endl;
+        exit(-1);
+    }
+
+    //the routing code trusts the table, so check it once here
+    for (int src = 0; src < N; src++){
+        for (int dst = 0; dst < N; dst++){
+            std::size_t c = (std::size_t)src * N + dst;
+            if (_offsets[c + 1] < _offsets[c]){
+                cout << "Error! Bad offsets in vlb_inode_table file " << file_name << " . Exiting." << endl;
+                exit(-1);
+            }
+            for (uint32_t ii = _offsets[c]; ii < _offsets[c + 1]; ii++){
+                if ((_nodes[ii] >= N) || (_nodes[ii] == src) || (_nodes[ii] == dst)){
+                    cout << "Error! Bad i-node " << _nodes[ii] << " for " << src << " -> " << dst << " in vlb_inode_table file " << file_name << " . Exiting." << endl;
+                    exit(-1);
+                }
+            }
+        }
+    }
+
+    _num_nodes = N;
+}
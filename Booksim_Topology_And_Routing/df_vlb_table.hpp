@@ -0,0 +1,63 @@
+#ifndef _DF_VLB_TABLE_HPP_
+#define _DF_VLB_TABLE_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "df_graph.hpp"
+#include "df_candidate_cache.hpp"
+
+/*
+Per (src_router, dst_router) i-node lists made offline by
+PathSetOptimizer/vlb_path_optimizer.py, for the *_table routing modes.
+
+The file is little-endian binary:
+    uint32  magic           DF_VLB_TABLE_MAGIC
+    uint32  version         DF_VLB_TABLE_VERSION
+    uint32  num_nodes       no of routers
+    uint32  reserved        0
+    uint64  topology_hash   df_topology_hash() of the graph the table was made for
+    uint32  offsets[num_nodes * num_nodes + 1]
+    uint16  nodes[offsets[num_nodes * num_nodes]]
+The i-nodes of (src,dst) are nodes[offsets[src * num_nodes + dst] .. offsets[src * num_nodes + dst + 1]).
+Pairs without a list (e.g. src and dst in the same group) have an empty range.
+
+The table is read as is, so a lookup is two loads and picking from the list is O(1).
+*/
+
+#define DF_VLB_TABLE_MAGIC 0x54564644   //"DFVT"
+#define DF_VLB_TABLE_VERSION 1
+
+//FNV-1a over no of nodes and every (src, dst, weight, width) edge in row order.
+//vlb_path_optimizer.py computes the same value from the topology file.
+uint64_t df_topology_hash(const DFGraph &graph);
+
+class DFVlbTable {
+    int _num_nodes;
+    std::vector<uint32_t> _offsets;
+    std::vector<uint16_t> _nodes;
+
+public:
+    DFVlbTable() : _num_nodes(0) {}
+
+    //exits if the file can't be read or was made for another topology
+    void load(const std::string &file_name, const DFGraph &graph);
+
+    inline bool loaded() const { return _num_nodes > 0; }
+
+    inline DFCandidateView get(int src, int dst) const {
+        std::size_t c = (std::size_t)src * _num_nodes + dst;
+        DFCandidateView view;
+        view.count = _offsets[c + 1] - _offsets[c];
+        view.nodes = _nodes.data() + _offsets[c];
+        return view;
+    }
+
+    inline std::size_t bytes() const {
+        return _offsets.size() * sizeof(uint32_t) + _nodes.size() * sizeof(uint16_t);
+    }
+};
+
+#endif
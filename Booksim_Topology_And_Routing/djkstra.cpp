@@ -18,6 +18,9 @@ Data type:
 #include <iostream>
 #include <vector>
 #include <queue>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 #include "djkstra.hpp"
 
@@ -77,15 +80,30 @@ class MyComparison{
 
 };
 
-void djkstra(int src, int N, std::vector < std::vector < std::pair<int,int> > >& graph, std::vector< int >& distance, std::vector< std::vector<int> >& parents){
+void sort_parents(int N, std::vector< std::vector<int> >& parents){
+    /*
+    Puts every parent list in ascending router ID order (-1, the path terminator
+    of the source, is its only entry). The engines find the parents in
+    different orders, the heap and the buckets break ties differently. Sorted,
+    both give the same lists, so the parent pool, the path pool and the paths
+    sampled from them don't depend on the engine.
+    */
+    for (int node = 0; node < N; node++){
+        if (parents[node].size() > 1){
+            std::sort(parents[node].begin(), parents[node].end());
+        }
+    }
+}
+
+void djkstra(int src, int N, const DFGraph& graph, std::vector< int >& distance, std::vector< std::vector<int> >& parents){
     /*
     Finds all wieghted shortest paths from src.
     Will populate the Parents list. Will think about its structure later.
     
     src:    the node from where the paths are started
     N:      total nodes in the network
-    graph:  Adjacency list along with path weight.
-            For each src node, there will be a list of (dst, link_weight)
+    graph:  CSR router graph. For each src node, the out-links are
+            graph.begin(src) .. graph.end(src), each with dst and link weight.
     */
     
     //    cout << "inside djkstra ..." << endl;
@@ -120,13 +138,19 @@ void djkstra(int src, int N, std::vector < std::vector < std::pair<int,int> > >&
         
         min_heap.pop();
         
+        //a node is pushed again for every extra parent. Expand it only once,
+        //or its neighbors get the same parent more than once.
+        if (visited[top_node]){
+            continue;
+        }
+        
         //mark it as visited
         visited[top_node] = true;
         
         //check each neighbor of the top_node
-        for( std::size_t ii = 0; ii < graph[top_node].size(); ii++){
-            neighbor_node = graph[top_node][ii].first;
-            neighbor_weight = graph[top_node][ii].second;
+        for( const DFEdge *edge = graph.begin(top_node); edge != graph.end(top_node); edge++){
+            neighbor_node = edge->dst;
+            neighbor_weight = edge->weight;
             
             //if neighbor is not already visited:
             if (visited[neighbor_node] == false){
@@ -147,6 +171,8 @@ void djkstra(int src, int N, std::vector < std::vector < std::pair<int,int> > >&
         
     }//that should be it    
     
+    sort_parents(N, parents);
+    
     //cout << "end of djkstra." << endl;
     
     /*cout << "Test printing the distances table " << endl;
@@ -165,38 +191,262 @@ void djkstra(int src, int N, std::vector < std::vector < std::pair<int,int> > >&
     
 }
 
-void all_pair_djkstra(int N, std::vector < std::vector < std::pair<int,int> > >& graph, std::vector< std::vector< int >>& distance, std::vector< std::vector< std::vector<int> > >& parents){
+void link_weight_range(const DFGraph& graph, int& min_weight, int& max_weight){
     /*
-    For every source node in the graph, call djksta.
+    Smallest and largest link weight in the graph. Both 0 for an empty graph.
     */
+    min_weight = 0;
+    max_weight = 0;
     
+    for (std::size_t ii = 0; ii < graph.edges.size(); ii++){
+        if (ii == 0 || graph.edges[ii].weight < min_weight){
+            min_weight = graph.edges[ii].weight;
+        }
+        if (ii == 0 || graph.edges[ii].weight > max_weight){
+            max_weight = graph.edges[ii].weight;
+        }
+    }
+}
+
+void djkstra_bucket_queue(int src, int N, const DFGraph& graph, int max_weight, std::vector< int >& distance, std::vector< std::vector<int> >& parents){
     /*
-    N: total nodes
-    graph: weighted adjacency list
-    distance: 2D vector containing the djksta distance between each SD pair
-    parents: 3d vector containing the parent of each node according to djkstra
+    Same as djkstra(), but with a bucket queue (Dial's algorithm) instead of 
+    the binary heap. Works only for positive integer link weights, which is all we 
+    have (LOCAL_LINK_WEIGHT and GLOBAL_LINK_WEIGHT).
+    
+    src, N, graph, distance, parents: same as djkstra()
+    max_weight: the largest link weight in the graph. 
+    
+    The queue is max_weight+1 buckets used in a circle. Every node waiting in the 
+    queue has a distance in [current, current + max_weight], so bucket 
+    (distance % num_buckets) is never shared by two different distances. Relaxing
+    from the current bucket never pushes into it again (weights are >= 1), 
+    so it can be scanned while the others are being filled.
+    
+    A node is expanded only once, the first time it comes out of the queue with 
+    its final distance. Stale entries (pushed before a shorter path was found) are 
+    skipped. So every parent is recorded exactly once.
     */
     
-    int src;
+    int num_buckets = max_weight + 1;
+    std::vector< std::vector<int> > buckets(num_buckets);
+    std::vector< bool > visited(N, false);
+    
+    int current_distance = 0;
+    int queued = 0;
+    int top_node, neighbor_node, new_distance;
+    std::size_t ii;
     
-    for(src = 0; src<N; src++){
-        djkstra(src, N, graph, distance[src], parents[src]);
+    distance[src] = 0;
+    parents[src].push_back(-1); //-1 will work as a path terminator
+    buckets[0].push_back(src);
+    queued++;
+    
+    while(queued > 0){
+        std::vector<int> &bucket = buckets[current_distance % num_buckets];
         
-        /*cout << "Test printing the distances table " << endl;
-        for( int ii = 0; ii<distance[src].size(); ii++){
-            cout << ii << "," << distance[src][ii] << endl;
-        }*/
+        for (ii = 0; ii < bucket.size(); ii++){
+            top_node = bucket[ii];
+            queued--;
+            
+            if (visited[top_node] || distance[top_node] != current_distance){
+                continue;   //stale entry
+            }
+            visited[top_node] = true;
+            
+            for( const DFEdge *edge = graph.begin(top_node); edge != graph.end(top_node); edge++){
+                neighbor_node = edge->dst;
+                if (visited[neighbor_node]){
+                    continue;
+                }
+                new_distance = current_distance + edge->weight;
+                
+                if (new_distance < distance[neighbor_node]){
+                    distance[neighbor_node] = new_distance;
+                    parents[neighbor_node].assign(1, top_node);
+                    buckets[new_distance % num_buckets].push_back(neighbor_node);
+                    queued++;
+                }
+                else if (new_distance == distance[neighbor_node]){
+                    parents[neighbor_node].push_back(top_node);
+                }
+            }
+        }
         
+        bucket.clear();
+        current_distance++;
+    }
+    
+    sort_parents(N, parents);
+}
+
+uint64_t count_shortest_paths(int node, const std::vector< std::vector<int> >& parents, std::vector< uint64_t >& path_count){
+    /*
+    No of shortest paths from the source to node: 1 for the source (parent -1),
+    otherwise the sum over the parents. path_count holds 0 for nodes not counted
+    yet and caches the rest. The recursion is only as deep as the longest path.
+    */
+    if (path_count[node] != 0){
+        return path_count[node];
+    }
+    uint64_t total = 0;
+    for (std::size_t ii = 0; ii < parents[node].size(); ii++){
+        if (parents[node][ii] == -1){
+            total += 1;
+        }else{
+            total += count_shortest_paths(parents[node][ii], parents, path_count);
+        }
+    }
+    path_count[node] = total;
+    return total;
+}
+
+void all_pair_djkstra(int N, const DFGraph& graph, DFDjkstraTable& table, int num_threads, int num_sources){
+    /*
+    For every source node in the graph, call djksta.
+    */
+    
+    /*
+    N: total nodes
+    graph: CSR router graph with link weights
+    table: flat distance and parent tables (see df_djkstra_table.hpp). 
+            Allocated and filled here.
+    num_threads: no of worker threads. <= 0 means one per hardware thread.
+    num_sources: run only from sources [0, num_sources). < 0 means all N. 
+                table gets only that many rows.
+    
+    Every single-source run only reads the graph and only writes its own
+    rows, so the sources are just handed out to the threads one at a time 
+    through an atomic counter. No locking needed.
+    
+    Each worker runs djkstra into its own scratch distance/parents vectors 
+    (reused from one source to the next), then writes the distance row straight 
+    into the table and packs the parent lists of the row into one buffer. 
+    Once all rows are done, the row buffers are concatenated into the pool.
+    The no of shortest paths of every cell is counted on the way, for sampling.
+    */
+    
+    if (num_threads <= 0){
+        num_threads = std::thread::hardware_concurrency();
+        if (num_threads <= 0){
+            num_threads = 1;    //hardware_concurrency() can return 0 if it can't tell
+        }
+    }
+    if (num_sources < 0 || num_sources > N){
+        num_sources = N;
+    }
+    if (num_threads > num_sources){
+        num_threads = num_sources;
+    }
+    
+    std::size_t num_cells = (std::size_t)num_sources * N;
+    table.num_rows = num_sources;
+    table.num_nodes = N;
+    std::vector<uint8_t> cell_distance(num_cells, DF_DJKSTRA_INF_DISTANCE);
+    std::vector<uint32_t> cell_parent_offsets(num_cells + 1, 0);
+    std::vector<uint32_t> cell_path_counts(num_cells, 0);
+    std::vector< std::vector<uint16_t> > row_parents(num_sources);
+    
+#ifdef DJKSTRA_BUCKET_QUEUE
+    int min_weight, max_weight;
+    link_weight_range(graph, min_weight, max_weight);
+    bool use_bucket_queue = (min_weight >= 1);  //Dial's algorithm can't handle 0 weight links
+#endif
+    
+    std::atomic<int> next_src(0);
+    
+    auto worker = [&](){
+        int src, dst;
+        std::size_t ii, cell;
+        std::vector< int > distance(N);
+        std::vector< std::vector<int> > parents(N);
+        std::vector< uint64_t > path_count(N);
         
+        while ((src = next_src.fetch_add(1)) < num_sources){
+            distance.assign(N, INF);
+            for (dst = 0; dst < N; dst++){
+                parents[dst].clear();
+            }
+            
+#ifdef DJKSTRA_BUCKET_QUEUE
+            if (use_bucket_queue){
+                djkstra_bucket_queue(src, N, graph, max_weight, distance, parents);
+            }else{
+                djkstra(src, N, graph, distance, parents);
+            }
+#else
+            djkstra(src, N, graph, distance, parents);
+#endif
+            
+            path_count.assign(N, 0);
+            
+            std::vector<uint16_t> &row = row_parents[src];
+            for (dst = 0; dst < N; dst++){
+                cell = (std::size_t)src * N + dst;
+                
+                if (distance[dst] != INF){
+                    if (distance[dst] >= DF_DJKSTRA_INF_DISTANCE){
+                        cout << "Error! djkstra distance " << distance[dst] << " between " << src << " and " << dst << " does not fit in the table. Exiting." << endl;
+                        exit(-1);
+                    }
+                    cell_distance[cell] = (uint8_t)distance[dst];
+                }
+                
+                if (count_shortest_paths(dst, parents, path_count) > UINT32_MAX){
+                    cout << "Error! More than " << UINT32_MAX << " shortest paths between " << src << " and " << dst << ". Exiting." << endl;
+                    exit(-1);
+                }
+                cell_path_counts[cell] = (uint32_t)path_count[dst];
+                
+                //for now, offsets[cell+1] holds the no of parents of cell. Prefix summed later.
+                cell_parent_offsets[cell + 1] = parents[dst].size();
+                for (ii = 0; ii < parents[dst].size(); ii++){
+                    row.push_back(parents[dst][ii] == -1 ? DF_DJKSTRA_NO_PARENT : (uint16_t)parents[dst][ii]);
+                }
+            }
+        }
+    };
+    
+    std::vector<std::thread> pool;
+    for (int tt = 1; tt < num_threads; tt++){
+        pool.emplace_back(worker);
     }
+    worker();   //the calling thread works too
+    
+    for (std::size_t tt = 0; tt < pool.size(); tt++){
+        pool[tt].join();
+    }
+    
+    //counts to offsets, then move the row buffers into the pool
+    uint64_t total_parents = 0;
+    for (std::size_t cell = 0; cell < num_cells; cell++){
+        total_parents += cell_parent_offsets[cell + 1];
+        if (total_parents > UINT32_MAX){
+            cout << "Error! More than " << UINT32_MAX << " djkstra parents, the table offsets can't hold them. Exiting." << endl;
+            exit(-1);
+        }
+        cell_parent_offsets[cell + 1] = (uint32_t)total_parents;
+    }
+    
+    std::vector<uint16_t> all_parents;
+    all_parents.reserve(total_parents);
+    for (int src = 0; src < num_sources; src++){
+        all_parents.insert(all_parents.end(), row_parents[src].begin(), row_parents[src].end());
+        std::vector<uint16_t>().swap(row_parents[src]);
+    }
+    
+    table.distance.own(cell_distance);
+    table.parent_offsets.own(cell_parent_offsets);
+    table.parents.own(all_parents);
+    table.path_counts.own(cell_path_counts);
     
     /*cout << "\ntest printing the parents table:" << endl;
-    for(src = 0; src < N; src++){
+    for(int src = 0; src < num_sources; src++){
         cout << "src " << src << " -> "; 
-        for( int ii=0; ii<parents[src].size(); ii++){
+        for( int ii=0; ii<N; ii++){
             cout << " (" << ii << " : ";
-            for( int jj=0; jj < parents[src][ii].size(); jj++){
-                cout << parents[src][ii][jj] << ",";
+            for( int jj=0; jj < table.parent_count(src, ii); jj++){
+                cout << table.parent(src, ii, jj) << ",";
             }
             cout << ") ";
         }
@@ -206,18 +456,18 @@ void all_pair_djkstra(int N, std::vector < std::vector < std::pair<int,int> > >&
     /*src = 19;
     int dst = 0;
     cout << "calling generate path on " << src << " and " << dst << endl;
-    generate_path(src, dst, parents);
+    generate_path(src, dst, table, final_paths);
     cout << "path generation returned" << endl;*/
 }
 
 
-void generate_path(int src, int dst, std::vector< std::vector< std::vector<int> > >& parents, std::vector< std::vector<int> >& final_paths){
+void generate_path(int src, int dst, const DFDjkstraTable& table, std::vector< std::vector<int> >& final_paths){
     /*
     Given that a parent list is alreayd generated, this function
     generates the path from a given source to a given destination.
     
     src, dst: as they sounds.
-    parents: data structure generated by djkstra.
+    table: parent table generated by all_pair_djkstra().
     */
     bool flag = false;
 
@@ -227,7 +477,7 @@ void generate_path(int src, int dst, std::vector< std::vector< std::vector<int>
     std::vector<int> current_path;
     //std::vector< std::vector<int> > final_paths;
     
-    generate_path_internal(src_node, current, current_path, final_paths, parents);
+    generate_path_internal(src_node, current, current_path, final_paths, table);
     
     //    cout << "\nBack to outer function: " << endl;
     if (flag){
@@ -251,7 +501,7 @@ void generate_path(int src, int dst, std::vector< std::vector< std::vector<int>
     }
 }
 
-void generate_path_internal(int src_node, int current, std::vector<int>&  current_path, std::vector<std::vector<int> >& final_path, std::vector< std::vector< std::vector<int> > >& parents){
+void generate_path_internal(int src_node, int current, std::vector<int>&  current_path, std::vector<std::vector<int> >& final_path, const DFDjkstraTable& table){
     /*
     Recursive function to generate all the paths between a src and dst. 
     Called by generate_path() from outside.
@@ -265,8 +515,8 @@ void generate_path_internal(int src_node, int current, std::vector<int>&  curren
                 until the src is found.
     final_path: 2D vector to hold all the paths. Whenever a path is found, 
                 it is appended to this. 
-    parents: data structure, populated by djkstra. Basically keep the predecessor node 
-            determined through djkstra algorithm.
+    table: parent table, populated by all_pair_djkstra(). Basically keep the predecessor 
+            node(s) determined through djkstra algorithm.
     
     */
 
@@ -289,13 +539,13 @@ void generate_path_internal(int src_node, int current, std::vector<int>&  curren
     //    cout << endl;
     //    
     
-     int parent_count = parents[src_node][current].size();
+     int parent_count = table.parent_count(src_node, current);
     //cout << "parent_count: " << parent_count << endl;
     
     int parent;
 
     if (parent_count == 1){
-            parent = parents[src_node][current][0];
+            parent = table.parent(src_node, current, 0);
             
             if (parent == -1){
                 //path found. save final result.
@@ -315,13 +565,13 @@ void generate_path_internal(int src_node, int current, std::vector<int>&  curren
                 //cout << "branch 1. Path Not found." << endl;
                 
                 //no branching. No need to copy the path. Pass by reference.
-                generate_path_internal(src_node, parent, current_path, final_path, parents);
+                generate_path_internal(src_node, parent, current_path, final_path, table);
             }
         
     }else{
                 
         for ( int ii = 0; ii < parent_count; ii++){
-            parent = parents[src_node][current][ii];
+            parent = table.parent(src_node, current, ii);
             //cout << "branch 2 for parent " << parent << endl;
         
             if (parent == -1){
@@ -345,7 +595,7 @@ void generate_path_internal(int src_node, int current, std::vector<int>&  curren
                 std::vector<int>  current_path_copy(current_path);
                 //cout << "branch 2. Path Not found. Path copied." << endl;
                 
-                generate_path_internal(src_node, parent, current_path_copy, final_path, parents);
+                generate_path_internal(src_node, parent, current_path_copy, final_path, table);
             }
         }
         
@@ -363,38 +613,39 @@ void check_djkstra(){
         //        5 [(3, 3), (4, 1)]
     
     int N = 4;
-    std::vector < std::vector < std::pair<int,int> > > graph(N);
+    DFGraph graph;
+    graph.reset(N);
     
-    graph[0].push_back(std::make_pair(1,1));
-    graph[0].push_back(std::make_pair(2,3));
+    graph.add_edge(0, 1, 1, 1);
+    graph.add_edge(0, 2, 3, 1);
     
-    graph[1].push_back(std::make_pair(0,1));
-    graph[1].push_back(std::make_pair(3,3));
+    graph.add_edge(1, 0, 1, 1);
+    graph.add_edge(1, 3, 3, 1);
     
-    graph[2].push_back(std::make_pair(0,3));
-    graph[2].push_back(std::make_pair(3,1));
+    graph.add_edge(2, 0, 3, 1);
+    graph.add_edge(2, 3, 1, 1);
     
-    graph[3].push_back(std::make_pair(1,3));
-    graph[3].push_back(std::make_pair(2,1));
+    graph.add_edge(3, 1, 3, 1);
+    graph.add_edge(3, 2, 1, 1);
     
-    /*graph[4].push_back(std::make_pair(1,3));
-    graph[4].push_back(std::make_pair(5,1));
+    /*graph.add_edge(4, 1, 3, 1);
+    graph.add_edge(4, 5, 1, 1);
     
-    graph[5].push_back(std::make_pair(3,3));
-    graph[5].push_back(std::make_pair(4,1));
+    graph.add_edge(5, 3, 3, 1);
+    graph.add_edge(5, 4, 1, 1);
     */
+    graph.finalize();
     
     cout << "list of link generated: " << endl;
-    for( std::size_t ii = 0; ii<graph.size(); ii++){
-        for ( std::size_t jj = 0; jj<graph[ii].size(); jj++){
-            cout << ii << " , " << graph[ii][jj].first << " , " << graph[ii][jj].second << endl; 
+    for( int ii = 0; ii < graph.num_nodes; ii++){
+        for ( const DFEdge *edge = graph.begin(ii); edge != graph.end(ii); edge++){
+            cout << ii << " , " << edge->dst << " , " << edge->weight << endl; 
         }
     }
     
-    std::vector< std::vector< int >> distance(N, std::vector< int >(N,INF));
-    std::vector< std::vector< std::vector<int> > > parents(N, std::vector< std::vector<int> >(N));
+    DFDjkstraTable table;
     
-    all_pair_djkstra(N, graph, distance, parents);
+    all_pair_djkstra(N, graph, table, 1);
     
     //call djkstra
     /*djkstra(0, 4, graph);
@@ -403,6 +654,54 @@ void check_djkstra(){
     djkstra(3, 4, graph);*/
 }
 
+bool verify_djkstra_bucket_queue(int N, const DFGraph& graph){
+    /*
+    Runs both djkstra() and djkstra_bucket_queue() from every source and compares
+    the results. Distances and parent lists must match exactly, order included
+    (both engines sort the lists, see sort_parents()).
+    Prints the first few mismatches. Returns true if the two agree everywhere.
+    */
+    
+    int min_weight, max_weight;
+    link_weight_range(graph, min_weight, max_weight);
+    if (min_weight < 1){
+        cout << "verify_djkstra_bucket_queue(): smallest link weight is " << min_weight << ", bucket queue can't be used." << endl;
+        return false;
+    }
+    
+    int mismatch = 0;
+    int max_mismatch_to_print = 10;
+    
+    for (int src = 0; src < N; src++){
+        std::vector< int > heap_distance(N, INF), bucket_distance(N, INF);
+        std::vector< std::vector<int> > heap_parents(N), bucket_parents(N);
+        
+        djkstra(src, N, graph, heap_distance, heap_parents);
+        djkstra_bucket_queue(src, N, graph, max_weight, bucket_distance, bucket_parents);
+        
+        for (int dst = 0; dst < N; dst++){
+            if (heap_distance[dst] != bucket_distance[dst] || heap_parents[dst] != bucket_parents[dst]){
+                if (mismatch < max_mismatch_to_print){
+                    cout << "djkstra mismatch for (" << src << "," << dst << "): distance " 
+                        << heap_distance[dst] << " vs " << bucket_distance[dst] << ", parents ";
+                    for (std::size_t ii = 0; ii < heap_parents[dst].size(); ii++){
+                        cout << heap_parents[dst][ii] << " ";
+                    }
+                    cout << "vs ";
+                    for (std::size_t ii = 0; ii < bucket_parents[dst].size(); ii++){
+                        cout << bucket_parents[dst][ii] << " ";
+                    }
+                    cout << endl;
+                }
+                mismatch++;
+            }
+        }
+    }
+    
+    cout << "verify_djkstra_bucket_queue(): " << N << " sources, " << mismatch << " mismatches." << endl;
+    return (mismatch == 0);
+}
+
 int main_1(){
     cout << "Hello World!" << endl;
     
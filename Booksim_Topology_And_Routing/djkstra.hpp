@@ -1,7 +1,33 @@
-void generate_path(int src, int dst, std::vector< std::vector< std::vector<int> > >& parents, std::vector< std::vector<int> >& final_paths);
+#include "df_graph.hpp"
+#include "df_djkstra_table.hpp"
 
-void generate_path_internal(int current_node, int dst, std::vector<int> & current_path, std::vector<std::vector<int> >& final_path, std::vector< std::vector< std::vector<int> > >& parents);
+/*
+Single-source engine used by all_pair_djkstra(). With DJKSTRA_BUCKET_QUEUE it is
+djkstra_bucket_queue() (Dial's algorithm, O(E + max distance) per source), 
+otherwise the binary heap djkstra(). Both give the same distance and parent tables,
+every parent list in ascending router ID order.
+Comment it out to go back to the heap version.
+*/
+#define DJKSTRA_BUCKET_QUEUE
 
-void djkstra(int src, int N, std::vector < std::vector < std::pair<int,int> > >& graph, std::vector< int >& distance, std::vector< std::vector<int> >& parents);
+//Uncomment to check the bucket queue against the heap version (every source, 
+//every arrangement) when the dragonfly is built. Exits on a mismatch.
+//#define DJKSTRA_VERIFY_BUCKET_QUEUE
 
-void all_pair_djkstra(int N, std::vector < std::vector < std::pair<int,int> > >& graph, std::vector< std::vector< int >>& distance, std::vector< std::vector< std::vector<int> > >& parents);
+void generate_path(int src, int dst, const DFDjkstraTable& table, std::vector< std::vector<int> >& final_paths);
+
+void generate_path_internal(int current_node, int dst, std::vector<int> & current_path, std::vector<std::vector<int> >& final_path, const DFDjkstraTable& table);
+
+void sort_parents(int N, std::vector< std::vector<int> >& parents);
+
+void djkstra(int src, int N, const DFGraph& graph, std::vector< int >& distance, std::vector< std::vector<int> >& parents);
+
+void djkstra_bucket_queue(int src, int N, const DFGraph& graph, int max_weight, std::vector< int >& distance, std::vector< std::vector<int> >& parents);
+
+void link_weight_range(const DFGraph& graph, int& min_weight, int& max_weight);
+
+uint64_t count_shortest_paths(int node, const std::vector< std::vector<int> >& parents, std::vector< uint64_t >& path_count);
+
+void all_pair_djkstra(int N, const DFGraph& graph, DFDjkstraTable& table, int num_threads = 1, int num_sources = -1);
+
+bool verify_djkstra_bucket_queue(int N, const DFGraph& graph);
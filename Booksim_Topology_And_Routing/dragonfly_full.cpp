@@ -7,6 +7,8 @@
 #include <algorithm>
 
 #include <fstream>
+#include <iomanip>
+#include <random>
 
 #include "random_utils.hpp"
 #include "combinations.hpp"
@@ -14,6 +16,13 @@
 #include "dragonfly_full.hpp"
 
 #include "djkstra.hpp"
+#include "df_path_pool.hpp"
+#include "df_candidate_cache.hpp"
+#include "df_bitset.hpp"
+#include "df_vlb_table.hpp"
+#include "df_next_hop_table.hpp"
+#include "df_snapshot.hpp"
+#include "df_port_index.hpp"
 #define INF 9999    
     //this is critical for djkstra to work. Don't change it.
 
@@ -36,38 +45,35 @@ We need:
 
 So here are the data types we are going to used:
 
-g_graph: a 2D vector of type int, of dimension N * node_degree. 
-        Contains the neighbor of each node
-    
-g_link_weights: a 2D vector of type int, of dimension N * node_degree
-        Contains the weight of the link.
-        Weight is basically the type of links, used in routing.
-        By default, weight is 1 for local links, and 3 for global links. 
-
-g_link_widths: a 2D vector of type int, of dimension N * node_degree
-        Contains the width of the link.
-        Width means how many links go between that SD pair.
-        Usually its 1, but depedning on link arrangement policy, it can be mroe than 1.
-
-g_global_link_frequency: an unordered_map that uses the (src,dest) pair as key 
-                and its width as value.
-                This kind of makes g_link_widths redundant, but lets have both. Juse because.        
+g_graph: the router graph in CSR form (see df_graph.hpp). One DFEdge record per
+        (router, neighbor) link, the rows are back to back in one buffer.
+        g_graph.begin(n) .. g_graph.end(n) are the out-links of router n. The first
+        _a - 1 of them are the local links, ordered by the local index of the neighbor,
+        the rest are the global links. Each record holds:
+            dst:    the neighbor.
+            weight: the type of the link, used in routing.
+                    By default, weight is 1 for local links, and 3 for global links.
+            width:  how many links go between that SD pair.
+                    Usually its 1, but depedning on link arrangement policy, it can be mroe than 1.
+            first_port: the first of the width output ports going to dst.
+
+g_inter_group_links: all the global links, bucketed by (src_group, dst_group).
+                The links from group s to group d are
+                g_inter_group_links[ g_inter_group_link_offsets[s*g + d] .. g_inter_group_link_offsets[s*g + d + 1] ).
+                A link of width w is listed w times.
+
+Port map: for a (src, dest) router pair, the [start_port, end_port] range of
+            output ports at src that go to dest. Kept dense, built in _CreatePortMap():
+            
+            local links are always one port wide and laid out in the order of the
+            local index within the group, so the port is computed directly.
 
-So, 
-g_graph[0][5] = 10 means node 0 is connected to node 10 as its sixth neighbor.
-g_link_weights[0][5] = 3 means the weight of the link between node 0 and its 
-                        sixth neighbor (node 10) is 3.
-g_link_widths[0][5] = 2 means the width of the link between node 0 and its 
-                        sixth neighbor (node 10) is 2.
-                        
-These two arrays could've been glued together, but I think this is cleaner.
+            global links are looked up in the global part of the router's
+            g_graph row, first_port and width give the range. g_global_port_index
+            (df_port_index.hpp) gives the edge of a global neighbor in O(1).
 
-
-g_port_map: a unordered_map that uses the (src,dest) pair as key and 
-            [start_port, end_port] pair as value.
-            
-so g_port_map[(0,5)] = (5,6) means node 0 is connected to node 5, and there are
-            two output ports, ports 5 and 6, from node 0 to 5.
+so if node 0 has a global edge {dst 5, width 2, first_port 5}, then
+            ports 5 and 6 go from node 0 to 5.
 
 
 
@@ -84,6 +90,8 @@ int g_h;
 int g_p;
 int g_N;
 int g_threshold;
+int g_multitiered_threshold_0;
+int g_multitiered_threshold_1;
 int g_log_Qlen_data;
 
 #define LOCAL_LINK_WEIGHT 1
@@ -91,45 +99,186 @@ int g_log_Qlen_data;
 
 string g_routing_function;
 
-string g_routing_mode; 
-string g_ugal_multiply_mode;
-string g_ugal_local_vs_global_switch;
+DFRoutingMode g_routing_mode;
+DFUgalMultiplyMode g_ugal_multiply_mode;
+DFUgalSwitch g_ugal_local_vs_global_switch;
 int g_five_hop_percentage;
 
-string g_vc_allocation_mode;
-    
-std::vector < std::vector <int> > g_graph;
-std::vector < std::vector <int> > g_link_weights;
-std::vector < std::vector <int> > g_link_widths;
+//no of MIN and VLB candidate paths select_UGAL_path() compares
+int g_ugal_min_candidates;
+int g_ugal_vlb_candidates;
+
+DFVcAllocationMode g_vc_allocation_mode;
+DFParRevaluation g_par_revaluation;
+
+//Per-mode dispatch tables, indexed by DFRoutingMode.
+//Keep them in the same order as the enum in dragonfly_full.hpp.
+const char * const g_routing_mode_names[DF_NUM_ROUTING_MODES] = {
+    "not_applicable",
+    "vanilla",
+    "two_hop",
+    "restricted_src_only",
+    "restricted_src_and_dst",
+    "four_hop_restricted",
+    "three_hop_restricted",
+    "four_hop_some_five_hop_restricted",
+    "threshold",
+    "multitiered",
+    "table"
+};
+
+/*
+One row per routing_function. RegisterRoutingFunctions() registers every kernel
+as name + "_dragonflyfull", and _setRoutingMode() takes the modes of the row
+with the configured name, so a name and its modes can't drift apart.
+The kernel template arguments fix the i-node selector, the path flavor and the
+UGAL switch at compile time:
+    - two_hop and threshold use df_min paths to and from the i-node, the
+      restricted modes (and multitiered, whose lower tiers are restricted) use
+      djkstra paths. So does table, the offline optimizer scores the i-nodes
+      with djkstra paths.
+    - UGAL_G and UGAL_L differ only in the final min vs vlb path choice.
+    - PAR is UGAL_L with a second look in the source group.
+    - *_perhop keep no path in the flit. Both halves of a VLB route are djkstra
+      minimal, so only the i-node selector differs. UGAL_G and PAR need the
+      whole path, so they have no per-hop version.
+*/
+struct DFRoutingFunctionEntry {
+    const char *name;
+    DFRoutingMode mode;
+    DFUgalSwitch ugal_switch;
+    bool per_hop;
+    tRoutingFunction kernel;
+};
+
+const DFRoutingFunctionEntry g_routing_function_table[] = {
+    {"min", DF_MODE_NOT_APPLICABLE, DF_UGAL_NOT_APPLICABLE, false, &min_dragonflyfull},
+    {"min_djkstra", DF_MODE_NOT_APPLICABLE, DF_UGAL_NOT_APPLICABLE, false, &min_djkstra_dragonflyfull},
+
+    {"vlb", DF_MODE_VANILLA, DF_UGAL_NOT_APPLICABLE, false, &vlb_dragonflyfull_kernel<&imdt_node_vanilla, &select_shortest_path>},
+    {"vlb_restricted_src_only", DF_MODE_RESTRICTED_SRC_ONLY, DF_UGAL_NOT_APPLICABLE, false, &vlb_dragonflyfull_kernel<&imdt_node_five_hop_src_only, &select_shortest_path_djkstra>},
+    {"vlb_restricted_src_and_dst", DF_MODE_RESTRICTED_SRC_AND_DST, DF_UGAL_NOT_APPLICABLE, false, &vlb_dragonflyfull_kernel<&imdt_node_five_hop_src_and_dst, &select_shortest_path_djkstra>},
+    {"vlb_four_hop_restricted", DF_MODE_FOUR_HOP_RESTRICTED, DF_UGAL_NOT_APPLICABLE, false, &vlb_dragonflyfull_kernel<&imdt_node_four_hop, &select_shortest_path_djkstra>},
+    {"vlb_four_hop_some_five_hop_restricted", DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED, DF_UGAL_NOT_APPLICABLE, false, &vlb_dragonflyfull_kernel<&imdt_node_four_hop_some_five_hop, &select_shortest_path_djkstra>},
+    {"vlb_table", DF_MODE_TABLE, DF_UGAL_NOT_APPLICABLE, false, &vlb_dragonflyfull_kernel<&imdt_node_table, &select_shortest_path_djkstra>},
+
+    {"UGAL_L", DF_MODE_VANILLA, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_vanilla, &select_shortest_path, DF_UGAL_LOCAL>},
+    {"UGAL_L_two_hop", DF_MODE_TWO_HOP, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_five_hop_src_only, &select_shortest_path, DF_UGAL_LOCAL>},
+    {"UGAL_L_restricted_src_only", DF_MODE_RESTRICTED_SRC_ONLY, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_five_hop_src_only, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+    {"UGAL_L_restricted_src_and_dst", DF_MODE_RESTRICTED_SRC_AND_DST, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_five_hop_src_and_dst, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+    {"UGAL_L_four_hop_restricted", DF_MODE_FOUR_HOP_RESTRICTED, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_four_hop, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+    {"UGAL_L_three_hop_restricted", DF_MODE_THREE_HOP_RESTRICTED, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_three_hop, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+    {"UGAL_L_threshold", DF_MODE_THRESHOLD, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_threshold, &select_shortest_path, DF_UGAL_LOCAL>},
+    {"UGAL_L_four_hop_some_five_hop_restricted", DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_four_hop_some_five_hop, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+    {"UGAL_L_multitiered", DF_MODE_MULTITIERED, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_multitiered, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+    {"UGAL_L_table", DF_MODE_TABLE, DF_UGAL_LOCAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_table, &select_shortest_path_djkstra, DF_UGAL_LOCAL>},
+
+    {"UGAL_G", DF_MODE_VANILLA, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_vanilla, &select_shortest_path, DF_UGAL_GLOBAL>},
+    {"UGAL_G_restricted_src_only", DF_MODE_RESTRICTED_SRC_ONLY, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_five_hop_src_only, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+    {"UGAL_G_restricted_src_and_dst", DF_MODE_RESTRICTED_SRC_AND_DST, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_five_hop_src_and_dst, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+    {"UGAL_G_four_hop_restricted", DF_MODE_FOUR_HOP_RESTRICTED, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_four_hop, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+    {"UGAL_G_three_hop_restricted", DF_MODE_THREE_HOP_RESTRICTED, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_three_hop, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+    {"UGAL_G_four_hop_some_five_hop_restricted", DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_four_hop_some_five_hop, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+    {"UGAL_G_multitiered", DF_MODE_MULTITIERED, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_multitiered, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+    {"UGAL_G_table", DF_MODE_TABLE, DF_UGAL_GLOBAL, false, &UGAL_dragonflyfull_kernel<&imdt_node_table, &select_shortest_path_djkstra, DF_UGAL_GLOBAL>},
+
+    {"PAR", DF_MODE_VANILLA, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_vanilla, &select_shortest_path>},
+    {"PAR_restricted_src_only", DF_MODE_RESTRICTED_SRC_ONLY, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_five_hop_src_only, &select_shortest_path_djkstra>},
+    {"PAR_restricted_src_and_dst", DF_MODE_RESTRICTED_SRC_AND_DST, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_five_hop_src_and_dst, &select_shortest_path_djkstra>},
+    {"PAR_four_hop_restricted", DF_MODE_FOUR_HOP_RESTRICTED, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_four_hop, &select_shortest_path_djkstra>},
+    {"PAR_three_hop_restricted", DF_MODE_THREE_HOP_RESTRICTED, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_three_hop, &select_shortest_path_djkstra>},
+    {"PAR_four_hop_some_five_hop_restricted", DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_four_hop_some_five_hop, &select_shortest_path_djkstra>},
+    {"PAR_multitiered", DF_MODE_MULTITIERED, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_multitiered, &select_shortest_path_djkstra>},
+    {"PAR_table", DF_MODE_TABLE, DF_UGAL_LOCAL, false, &PAR_dragonflyfull_kernel<&imdt_node_table, &select_shortest_path_djkstra>},
+
+    {"min_perhop", DF_MODE_NOT_APPLICABLE, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_vanilla, DF_PERHOP_MIN>},
+    {"vlb_perhop", DF_MODE_VANILLA, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_vanilla, DF_PERHOP_VLB>},
+    {"vlb_restricted_src_only_perhop", DF_MODE_RESTRICTED_SRC_ONLY, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_five_hop_src_only, DF_PERHOP_VLB>},
+    {"vlb_restricted_src_and_dst_perhop", DF_MODE_RESTRICTED_SRC_AND_DST, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_five_hop_src_and_dst, DF_PERHOP_VLB>},
+    {"vlb_four_hop_restricted_perhop", DF_MODE_FOUR_HOP_RESTRICTED, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_four_hop, DF_PERHOP_VLB>},
+    {"vlb_four_hop_some_five_hop_restricted_perhop", DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_four_hop_some_five_hop, DF_PERHOP_VLB>},
+    {"vlb_table_perhop", DF_MODE_TABLE, DF_UGAL_NOT_APPLICABLE, true, &perhop_dragonflyfull_kernel<&imdt_node_table, DF_PERHOP_VLB>},
+    {"UGAL_L_perhop", DF_MODE_VANILLA, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_vanilla, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_restricted_src_only_perhop", DF_MODE_RESTRICTED_SRC_ONLY, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_five_hop_src_only, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_restricted_src_and_dst_perhop", DF_MODE_RESTRICTED_SRC_AND_DST, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_five_hop_src_and_dst, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_four_hop_restricted_perhop", DF_MODE_FOUR_HOP_RESTRICTED, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_four_hop, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_three_hop_restricted_perhop", DF_MODE_THREE_HOP_RESTRICTED, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_three_hop, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_four_hop_some_five_hop_restricted_perhop", DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_four_hop_some_five_hop, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_threshold_perhop", DF_MODE_THRESHOLD, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_threshold, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_multitiered_perhop", DF_MODE_MULTITIERED, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_multitiered, DF_PERHOP_UGAL_L>},
+    {"UGAL_L_table_perhop", DF_MODE_TABLE, DF_UGAL_LOCAL, true, &perhop_dragonflyfull_kernel<&imdt_node_table, DF_PERHOP_UGAL_L>}
+};
+
+const int g_num_routing_functions = sizeof(g_routing_function_table) / sizeof(g_routing_function_table[0]);
+
+
+DFGraph g_graph;
+
+//slot of every global neighbor in the router's g_graph row, built in _CreatePortMap()
+DFGlobalPortIndex g_global_port_index;
 
 //std::vector < std::unordered_map< int, std::pair<int,int> > > g_port_map; 
 
-std::unordered_map < std::pair<int, int>, int, pair_hash > g_global_link_frequency;
 
-std::unordered_map< std::pair<int, int>, std::pair<int,int>, pair_hash >  g_port_map; 
+//g_djkstra_table (distances and parents) is populated by djkstra; will be used in djkstra routing
+DFDjkstraTable g_djkstra_table;
+
+//If the arrangement is symmetric under shifting the group IDs, only the rows of 
+//the first g_djkstra_rows source routers are kept in g_djkstra_table. 
+//Row src for src >= g_djkstra_rows is row (src - shift) with every router 
+//renamed by +shift (mod g_N), shift being a multiple of g_djkstra_shift routers.
+//Without symmetry g_djkstra_rows = g_N and all rows are stored.
+int g_djkstra_rows;
+int g_djkstra_shift;
 
-//g_distance and g_parents are populated by djkstra; will be used in djkstra routing
-std::vector< std::vector< int >> g_distance;
-std::vector< std::vector< std::vector<int> > > g_parents;
+//all the djkstra minimal paths, enumerated from g_djkstra_table. Same rows.
+//Not built if g_djkstra_sample_paths is set. Then a path is sampled straight
+//from the parents in g_djkstra_table instead.
+DFPathPool g_djkstra_path_pool;
+bool g_djkstra_sample_paths;
 
 //We need all the channels between groups for routing
-std::vector< std::vector < std::vector <std::pair<int,int> > > > g_inter_group_links;
+std::vector< std::pair<int,int> > g_inter_group_links;
+std::vector<int> g_inter_group_link_offsets;   //_g * _g + 1 entries
 
 //For 4-hop-vlb-path generation, we need a list of i-nodes connected to each
-//pair of groups.
+//pair of groups. The list of group pair (s,d) is g_group_pair_vs_common_nodes[s*g + d].
+DFFlatLists<int> g_group_pair_vs_common_nodes;
+
+//Candidate i-node lists of the restricted modes only depend on the (src_router, dst_router)
+//pair, so each list is built the first time the pair is routed and cached after that.
+DFCandidateCache g_five_hop_candidates;         //vlb_imdt_node_for_five_hop_paths_src_and_dst()
+DFCandidateCache g_four_hop_candidates;         //vlb_imdt_node_for_four_hop_paths()
+DFCandidateCache g_three_hop_candidates;        //vlb_imdt_node_for_three_hop_paths()
+DFCandidateCache g_unique_five_hop_candidates;  //five hop i-nodes that are not four hop i-nodes
+
+//i-nodes per router pair for the *_table modes, made offline by PathSetOptimizer
+DFVlbTable g_vlb_inode_table;
+
+//With df_snapshot_dir set, the djkstra tables and the neighbor sets of an earlier
+//run with the same topology are mapped from here instead of being computed.
+//The mapping is shared, so concurrent runs on a node keep one copy of them.
+DFSnapshot g_snapshot;
 
-//std::vector< std::vector <std::vector <int> >> g_group_pair_vs_common_nodes;
+//*_perhop routing functions keep no path in the flit. Every router looks its 
+//next hop up here instead. Only built if the routing function is a *_perhop one.
+bool g_per_hop_routing;
+DFNextHopTable g_next_hop_table;
 
-std::unordered_map < std::pair<int, int>, std::vector<int>, pair_hash > g_group_pair_vs_common_nodes;
+//router at the other end of every input port, _radix entries per router. -1 for PE ports.
+//The *_perhop functions get the previous router from the in_channel with it.
+std::vector<int> g_input_port_router;
+int g_radix;
 
 
 //data structres needed to 2-hop neighbor cache.
-std::vector < std::unordered_set <int> > two_hop_neighbors_set;
-std::vector < std::vector <int> > two_hop_neighbors_vector;
+//one bitset over all routers per router, plus the same set as a sorted list.
+DFBitsetTable two_hop_neighbors_bits;
+DFFlatLists<int> two_hop_neighbors_vector;
 
 //data structure needed for 1-hop neighbor cache
-std::vector < std::unordered_set <int> > one_hop_neighbors_set;
-std::vector < std::vector <int> > one_hop_neighbors_vector;
+DFBitsetTable one_hop_neighbors_bits;
+DFFlatLists<int> one_hop_neighbors_vector;
 
 
 
@@ -158,12 +307,16 @@ DragonFlyFull::DragonFlyFull(const Configuration &config, const string &name) :
     _a = config.GetInt("df_a");
     _g = config.GetInt("df_g");
     _arrangement = config.GetStr("df_arrangement");
+    _arrangement_seed = config.GetInt("df_arrangement_seed");
     
     _routing = config.GetStr("routing_function");
 
 
     _threshold = config.GetInt("routing_threshold");
 
+    _multitiered_threshold_0 = config.GetInt("multitiered_routing_threshold_0");
+    _multitiered_threshold_1 = config.GetInt("multitiered_routing_threshold_1");
+
     _local_latency = config.GetInt("local_latency");
     _global_latency = config.GetInt("global_latency");
 
@@ -171,11 +324,30 @@ DragonFlyFull::DragonFlyFull(const Configuration &config, const string &name) :
 
     _five_hop_percentage = config.GetInt("five_hop_percentage");
 
+    _ugal_min_candidates = config.GetInt("ugal_min_candidates");
+    _ugal_vlb_candidates = config.GetInt("ugal_vlb_candidates");
+
  
     g_log_Qlen_data = config.GetInt("log_Qlen_data");
     
-    g_vc_allocation_mode = config.GetStr("vc_allocation_mode");
-    
+    _vc_allocation_mode = config.GetStr("vc_allocation_mode");
+
+    _par_revaluation = config.GetStr("par_revaluation");
+
+    _djkstra_threads = config.GetInt("djkstra_threads");
+
+    _djkstra_group_symmetry = config.GetInt("djkstra_group_symmetry");
+
+    _djkstra_path_pool_mb = config.GetInt("djkstra_path_pool_mb");
+
+    _candidate_cache_mb = config.GetInt("candidate_cache_mb");
+
+    _djkstra_path_selection = config.GetStr("djkstra_path_selection");
+
+    _topology_file = config.GetStr("df_topology_file");
+    _vlb_inode_table_file = config.GetStr("vlb_inode_table");
+    _snapshot_dir = config.GetStr("df_snapshot_dir");
+
     if (g_log_Qlen_data == 1){
 
         // current date/time based on current system
@@ -201,11 +373,32 @@ DragonFlyFull::DragonFlyFull(const Configuration &config, const string &name) :
         }
     }
 
-    //just going with the default settings. No immediate plan to change.
-    _h = _a/2;
-    _p = _a/2;
+    //global links and PEs per router. 0 = the balanced default, _a/2.
+    _h = config.GetInt("df_h");
+    _p = config.GetInt("df_p");
+    if (_h == 0){
+        _h = _a/2;
+    }
+    if (_p == 0){
+        _p = _a/2;
+    }
     
     _N = _a * _g;
+
+    //every group needs a global link to every other group, and every global
+    //port needs a port on the other end.
+    if ((_h < 1) || (_p < 1)){
+        cout << "Error! df_h and df_p must be at least 1, got " << _h << " and " << _p << " . Exiting." << endl;
+        exit(-1);
+    }
+    if (_g > _a * _h + 1){
+        cout << "Error! A group has " << _a * _h << " global links, not enough for " << _g << " groups (at most a*h+1 = " << _a * _h + 1 << "). Exiting." << endl;
+        exit(-1);
+    }
+    if (((long long)_N * _h) % 2 != 0){
+        cout << "Error! " << _N << " routers with " << _h << " global links each leave one global port unconnected. Exiting." << endl;
+        exit(-1);
+    }
     _radix = _a - 1 + _h + _p; //channels to intra-group routers + inter-group routers + to PEs
     
     cout << "_a: " << _a << "  _g: " << _g << "  _h: " << _h << "  _p: " << _p << "  _arrangement: "  << _arrangement << endl; 
@@ -216,8 +409,16 @@ DragonFlyFull::DragonFlyFull(const Configuration &config, const string &name) :
 
     cout << "Routing function: " << _routing << endl;
     cout << "ugal multiply mode: " << _ugal_multiply_mode << endl;
+    cout << "multitiered thresholds: " << _multitiered_threshold_0 << " , " << _multitiered_threshold_1 << endl;
+    cout << "ugal candidates: " << _ugal_min_candidates << " min, " << _ugal_vlb_candidates << " vlb" << endl;
 
-    cout << "vc_allocation_mode: " << g_vc_allocation_mode << endl;
+    cout << "vc_allocation_mode: " << _vc_allocation_mode << endl;
+    cout << "par_revaluation: " << _par_revaluation << endl;
+    cout << "djkstra_threads: " << _djkstra_threads << endl;
+    cout << "djkstra_group_symmetry: " << _djkstra_group_symmetry << endl;
+    cout << "djkstra_path_pool_mb: " << _djkstra_path_pool_mb << endl;
+    cout << "candidate_cache_mb: " << _candidate_cache_mb << endl;
+    cout << "djkstra_path_selection: " << _djkstra_path_selection << endl;
     
     // cout << "Routing threshold: " << _threshold << endl;
 
@@ -230,18 +431,60 @@ DragonFlyFull::DragonFlyFull(const Configuration &config, const string &name) :
     _BuildGraphForLocal();
     _BuildGraphForGlobal(_arrangement);
     _CreatePortMap();
+
+    if (_topology_file != ""){
+        _WriteTopology(_topology_file);
+    }
+
+    if (g_routing_mode == DF_MODE_TABLE){
+        if (_vlb_inode_table_file == ""){
+            cout << "Error! Routing function " << _routing << " needs a vlb_inode_table file. Exiting." << endl;
+            exit(-1);
+        }
+        g_vlb_inode_table.load(_vlb_inode_table_file, g_graph);
+        cout << "vlb_inode_table: " << _vlb_inode_table_file << " , " << g_vlb_inode_table.bytes() << " bytes" << endl;
+    }
     
     _ComputeSize( config );
     _Alloc( );
     _BuildNet( config );
     
-    _discover_djkstra_paths();
-    _generate_one_hop_neighbors();
-    _generate_two_hop_neighbors();
+    //the graph is cheap to build and names the snapshot, everything below it is not.
+    //Runs started together wait on the lock while the first one computes, then map its snapshot.
+    int snapshot_lock = -1;
+    if (_snapshot_dir != ""){
+        uint64_t key;
+        snapshot_lock = df_snapshot_lock(_SnapshotFileName(key));
+    }
+    if (_LoadSnapshot() == false){
+        _discover_djkstra_paths();
+        _generate_one_hop_neighbors();
+        _generate_two_hop_neighbors();
+
+        //this is only required for restricted routing where 4_hop paths are used. 
+        //set a conditional accordingly.
+        _generate_common_neighbors_for_group_pair();
+
+        //map back what was just written, so this run drops its private copy and shares too
+        if (_WriteSnapshot()){
+            _LoadSnapshot();
+        }
+    }
+    df_snapshot_unlock(snapshot_lock);
 
-    //this is only required for restricted routing where 4_hop paths are used. 
-    //set a conditional accordingly.
-    _generate_common_neighbors_for_group_pair();
+    _ReportTopologyQuality();
+
+    if (g_per_hop_routing){
+        g_next_hop_table.build(g_graph, g_djkstra_table, g_djkstra_shift);
+        cout << "next hop table: " << g_next_hop_table.bytes() << " bytes" << endl;
+    }
+
+    //i-node candidate lists of the restricted modes, filled on first use
+    std::size_t cache_budget = (std::size_t)_candidate_cache_mb * 1024 * 1024;
+    g_five_hop_candidates.reset(_N, cache_budget);
+    g_four_hop_candidates.reset(_N, cache_budget);
+    g_three_hop_candidates.reset(_N, cache_budget);
+    g_unique_five_hop_candidates.reset(_N, cache_budget);
 
     cout << "Done with DragonFlyFull() constructor ..." << endl;
     
@@ -311,12 +554,33 @@ void DragonFlyFull::_setGlobals(){
     g_h = _h;
     g_p = _p;
     g_N = _N;
+    g_radix = _radix;
+
+    //DFPath keeps router IDs in 16 bits.
+    if (_N > 65535){
+        cout << "Error! DFPath supports at most 65535 routers, got " << _N << " . Exiting." << endl;
+        exit(-1);
+    }
     
     g_routing_function = _routing;
     g_five_hop_percentage = _five_hop_percentage;
+
+    if ((_ugal_min_candidates < 1) || (_ugal_vlb_candidates < 1) || (_ugal_min_candidates + _ugal_vlb_candidates > DF_MAX_UGAL_CANDIDATES)){
+        cout << "Error! ugal_min_candidates and ugal_vlb_candidates must be at least 1 and add up to at most " << DF_MAX_UGAL_CANDIDATES << " . Got " << _ugal_min_candidates << " and " << _ugal_vlb_candidates << " . Exiting." << endl;
+        exit(-1);
+    }
+    g_ugal_min_candidates = _ugal_min_candidates;
+    g_ugal_vlb_candidates = _ugal_vlb_candidates;
     
     g_threshold = _threshold;
 
+    if (_multitiered_threshold_0 > _multitiered_threshold_1){
+        cout << "Error! multitiered_routing_threshold_0 (" << _multitiered_threshold_0 << ") is larger than multitiered_routing_threshold_1 (" << _multitiered_threshold_1 << "). Exiting." << endl;
+        exit(-1);
+    }
+    g_multitiered_threshold_0 = _multitiered_threshold_0;
+    g_multitiered_threshold_1 = _multitiered_threshold_1;
+
     //stat collection variables
     g_total_flit = 0;
     g_total_min_flit = 0;
@@ -345,98 +609,79 @@ void DragonFlyFull::_setRoutingMode(){
     //possible supported routings: 
         //min/ vlb/ UGAL_L/ UGAL_L_two_hop / UGAL_L_threshold/
         // PAR
-    if ((_routing == "UGAL_G") || (_routing == "UGAL_G_restricted_src_only") || (_routing == "UGAL_G_restricted_src_and_dst") || (_routing == "UGAL_G_four_hop_restricted") || (_routing == "UGAL_G_four_hop_some_five_hop_restricted") || (_routing == "UGAL_G_three_hop_restricted")){
-        g_ugal_local_vs_global_switch = "global";
-
-    } else if ( (_routing == "UGAL_L")  || (_routing == "UGAL_L_two_hop") || (_routing == "UGAL_L_restricted_src_only") || (_routing == "UGAL_L_restricted_src_and_dst") || (_routing == "UGAL_L_threshold")   || (_routing == "UGAL_L_four_hop_restricted") ||  (_routing == "UGAL_L_four_hop_some_five_hop_restricted") || (_routing == "UGAL_L_three_hop_restricted") || (_routing == "PAR") || (_routing == "PAR_restricted_src_only") || (_routing == "PAR_restricted_src_and_dst") || (_routing == "PAR_four_hop_restricted")|| (_routing == "PAR_four_hop_some_five_hop_restricted") || (_routing == "PAR_three_hop_restricted") ) {
-        g_ugal_local_vs_global_switch = "local";
-
-    } else{
-        g_ugal_local_vs_global_switch = "not_applicable";
+    
+    //the i-node mode, UGAL switch and per-hop flag come from the row of the
+    //routing function in g_routing_function_table.
+    //Unknown names (Booksim rejects them anyway) get no modes at all.
+    g_routing_mode = DF_MODE_NOT_APPLICABLE;
+    g_ugal_local_vs_global_switch = DF_UGAL_NOT_APPLICABLE;
+    g_per_hop_routing = false;
+
+    for (int ii = 0; ii < g_num_routing_functions; ii++){
+        if (_routing == g_routing_function_table[ii].name){
+            g_routing_mode = g_routing_function_table[ii].mode;
+            g_ugal_local_vs_global_switch = g_routing_function_table[ii].ugal_switch;
+            g_per_hop_routing = g_routing_function_table[ii].per_hop;
+            break;
+        }
     }
 
-    //possible modes: vanilla, two_hop, threshold,  not_applicable
 
-    if ((_routing == "vlb") || (_routing == "UGAL_L") || (_routing == "UGAL_G") || (_routing == "PAR")) {
-        g_routing_mode = "vanilla";
-    } 
-    else if (_routing == "UGAL_L_two_hop"){
-        g_routing_mode = "two_hop";    
-    }
-    else if ( (_routing == "vlb_restricted_src_only") || (_routing == "UGAL_L_restricted_src_only") || (_routing == "UGAL_G_restricted_src_only") || (_routing == "PAR_restricted_src_only") ){
-        g_routing_mode = "restricted_src_only";    
-    }
-    else if ( (_routing == "vlb_restricted_src_and_dst") || (_routing == "UGAL_L_restricted_src_and_dst") || (_routing == "UGAL_G_restricted_src_and_dst") || (_routing == "PAR_restricted_src_and_dst") ){
-        g_routing_mode = "restricted_src_and_dst";    
-    }
-    else if ( (_routing == "vlb_four_hop_restricted") || (_routing == "UGAL_L_four_hop_restricted") || (_routing == "UGAL_G_four_hop_restricted") || (_routing == "PAR_four_hop_restricted")  ){
-        g_routing_mode = "four_hop_restricted";    
-    }
-    else if (  (_routing == "UGAL_L_three_hop_restricted") || (_routing == "UGAL_G_three_hop_restricted") || (_routing == "PAR_three_hop_restricted")  ){
-        g_routing_mode = "three_hop_restricted";   
-    } 
-    else if ( (_routing == "vlb_four_hop_some_five_hop_restricted") || (_routing == "UGAL_L_four_hop_some_five_hop_restricted") || (_routing == "UGAL_G_four_hop_some_five_hop_restricted") || (_routing == "PAR_four_hop_some_five_hop_restricted")  ){
-        g_routing_mode = "four_hop_some_five_hop_restricted";    
-    }
-    else if (_routing == "UGAL_L_threshold"){
-        g_routing_mode = "threshold";    
+    //set ugal_multiply_mode
+    if (_ugal_multiply_mode == "one_vs_two"){
+        g_ugal_multiply_mode = DF_MULTIPLY_ONE_VS_TWO;
+    }else if (_ugal_multiply_mode == "pathlen_based"){
+        g_ugal_multiply_mode = DF_MULTIPLY_PATHLEN_BASED;
+    }else{
+        g_ugal_multiply_mode = DF_MULTIPLY_UNSUPPORTED;
     }
-  
-    else{
-        g_routing_mode = "not_applicable";    
+
+    //only UGAL_L uses the multiplier, so only complain if we are going to need it.
+    if ((g_ugal_local_vs_global_switch == DF_UGAL_LOCAL) && (g_ugal_multiply_mode == DF_MULTIPLY_UNSUPPORTED)){
+        cout << "Erorr! Unsupported ugal_multiply_mode: " << _ugal_multiply_mode << " . Exiting." << endl;
+        exit(-1);
     }
 
+    //set vc_allocation_mode
+    if (_vc_allocation_mode == "incremental"){
+        g_vc_allocation_mode = DF_VC_INCREMENTAL;
+    }else{
+        g_vc_allocation_mode = DF_VC_OPTIMAL;
+    }
 
-    //set ugal_multiply_mode
-    g_ugal_multiply_mode = _ugal_multiply_mode;
+    //set par_revaluation
+    if (_par_revaluation == "first_hop"){
+        g_par_revaluation = DF_PAR_FIRST_HOP;
+    }else if (_par_revaluation == "source_group"){
+        g_par_revaluation = DF_PAR_SOURCE_GROUP;
+    }else if (_par_revaluation == "source_and_intermediate_group"){
+        g_par_revaluation = DF_PAR_SOURCE_AND_INTERMEDIATE_GROUP;
+    }else{
+        cout << "Error! Unsupported par_revaluation: " << _par_revaluation << " . Exiting." << endl;
+        exit(-1);
+    }
 
 }
 
 
 void DragonFlyFull::_AllocateArrays(){
     /*
-    allocate the vectors:
-        std::vector < std::vector <int> > g_graph;
-        std::vector < std::vector <int> > g_link_weights;
-        //std::vector < std::unordered_map< int, std::pair<int,int> > > g_port_map; 
+    allocate the graph and the inter-group link index:
+        DFGraph g_graph;
+        std::vector<int> g_inter_group_link_offsets;
 
-    Each has a length of _N => number of routers 
-    g_graph and g_link_weights each have a row leght of router degree = _(_h + _a - 1)
-    
+    The graph rows are only laid out in _CreatePortMap(), once all the links are known.
     */
-    
+
     cout << "inside _AllocateArrays() ... " << endl;
-    
-    g_graph.resize(_N);
-    for (std::size_t ii=0; ii < g_graph.size(); ii++){
-        g_graph[ii] = std::vector<int> (_h + _a - 1, -1);  //-1 default value
-    }
-    
-    g_link_weights.resize(_N);
-    for (std::size_t ii=0; ii < g_link_weights.size(); ii++){
-        g_link_weights[ii] = std::vector<int> (_h + _a - 1, -1);  //-1 default value
-    }
-    
-    g_link_widths.resize(_N);
-    for (std::size_t ii=0; ii < g_link_widths.size(); ii++){
-        g_link_widths[ii] = std::vector<int> (_h + _a - 1, -1);  //-1 default value
-    }
-    
-    g_inter_group_links.resize(_g, std::vector< std::vector <std::pair<int,int>> >  (_g) );
 
-    //g_group_pair_vs_common_nodes.resize(_g, std::vector < std::vector <int>> (_g));
-    
-    /*g_port_map.resize(_N);
-    for( int ii = 0; ii < g_port_map.size(); ii++ ){
-        g_port_map[ii] = std::unordered_map< int, std::pair<int,int> > ();
-    }*/
-        
-    
-    //print_2d_vector(g_link_weights);
-    //test_vector_of_maps(g_port_map);
-    
+    g_graph.reset(_N);
+
+    g_inter_group_links.clear();
+    g_inter_group_link_offsets.assign(_g * _g + 1, 0);
+
     cout << "done with _AllocateArrays() ... " << endl;
-    
+
 }
     
 void DragonFlyFull::_ComputeSize(const Configuration &config){
@@ -462,7 +707,7 @@ void DragonFlyFull::_ComputeSize(const Configuration &config){
 void DragonFlyFull::_BuildNet(const Configuration &config){
     cout << "inside _BuildNet() ..." << endl;
     
-    int node, dst, count, channel_id, idx, width, channel_count, kk, link_type;
+    int node, dst, count, channel_id, width, channel_count, kk, link_type;
     ostringstream router_name; 
     
     all_routers.resize(_N);
@@ -503,19 +748,23 @@ void DragonFlyFull::_BuildNet(const Configuration &config){
     //create the channels
     
     /*
-    // g_graph already lists all the unidirectional links.
-    // g_port_map contains the width of each link.
-    // Based on these two, connect the actual links.
+    // g_graph already lists all the unidirectional links, with the width of each.
+    // Based on that, connect the actual links.
     
     // Go through each unidirectional link, check its width. 
     // Add that many outgoing channels in the src, and incoming channels in the dst.
     */
+    //input ports are numbered in the order AddInputChannel() is called: 
+    //_p PE ports, then the links in the order of this loop.
+    std::vector<int> input_count(_N, _p);
+    g_input_port_router.assign((std::size_t)_N * _radix, -1);
+
     channel_count = 0;
     for(node = 0; node < _N; node++){
-        for(idx = 0; idx < (_h + _a - 1); idx++){
-            dst = g_graph[node][idx];
-            width = g_link_widths[node][idx];
-            link_type = g_link_weights[node][idx];
+        for(const DFEdge *edge = g_graph.begin(node); edge != g_graph.end(node); edge++){
+            dst = edge->dst;
+            width = edge->width;
+            link_type = edge->weight;
             for (kk = 0; kk < width; kk++){
                 //connect the channels
                 _routers[node] -> AddOutputChannel(_chan[channel_count], _chan_cred[channel_count]);
@@ -539,6 +788,8 @@ void DragonFlyFull::_BuildNet(const Configuration &config){
 
                 
                 _routers[dst] -> AddInputChannel(_chan[channel_count], _chan_cred[channel_count]);
+                g_input_port_router[(std::size_t)dst * _radix + input_count[dst]] = node;
+                input_count[dst] += 1;
                 channel_count += 1;
             }
             //cout << "channel " << channel_count << " , node: " << node << " , dst: " << dst << " ,width: " << width << endl;
@@ -559,46 +810,289 @@ void DragonFlyFull :: _BuildGraphForLocal(){
     */
     
     //global data types to be populated:
-    //std::vector < std::vector <int> > g_graph;
-    //std::vector < std::vector <int> > g_link_weights;
-    
+    //DFGraph g_graph; (local links are always one channel wide)
+
         int node;
         int neighbor;
         int node_group;
-        int count;
-    
+        
     for(node = 0; node < _N; node++){
         //cout << "node " << node << endl;
         node_group = node/_a;
         //cout << "node group: " << node/_a << endl;
         
         //cout << "neighbors: ";
-        for(neighbor = node_group * _a, count = 0; neighbor < node_group *_a + _a; neighbor++ ){
-            
+        for(neighbor = node_group * _a; neighbor < node_group *_a + _a; neighbor++ ){
+
             if (neighbor != node){
                 //cout << neighbor << " ";
-            
+
                 //add it to graph
-                g_graph[node][count] = neighbor;
-                g_link_weights[node][count] = LOCAL_LINK_WEIGHT;
-                count += 1;
+                g_graph.add_edge(node, neighbor, LOCAL_LINK_WEIGHT, 1);
             }
             
         } 
         //cout << endl;
     }
     
-    //    cout << "\nTest printing the graph:" << endl;    
-    //    print_2d_vector(g_graph);
-    //    cout << "\nTest printing the link weights:" << endl;
-    //    print_2d_vector(g_link_weights);
-    //    
+}
+
+static void sort_link_indices_by_router(const std::vector< std::pair<int,int> > &links, int N, std::vector<int> &order){
+    /*
+    order gets the indices of links in (first, second) order. Router IDs are 
+    below N, so two counting sort passes do it, by second and then stably by
+    first. O(no of links + N).
+    */
+    std::vector<int> by_second(links.size());
+    std::vector<int> start(N + 1);
+    std::size_t ii;
+
+    for(ii = 0; ii < links.size(); ii++){
+        start[links[ii].second + 1] += 1;
+    }
+    for(int node = 0; node < N; node++){
+        start[node + 1] += start[node];
+    }
+    for(ii = 0; ii < links.size(); ii++){
+        by_second[start[links[ii].second]++] = ii;
+    }
+
+    std::fill(start.begin(), start.end(), 0);
+    for(ii = 0; ii < links.size(); ii++){
+        start[links[ii].first + 1] += 1;
+    }
+    for(int node = 0; node < N; node++){
+        start[node + 1] += start[node];
+    }
+    order.resize(links.size());
+    for(ii = 0; ii < links.size(); ii++){
+        order[start[links[by_second[ii]].first]++] = by_second[ii];
+    }
+}
+
+static void sort_links_by_router(std::vector< std::pair<int,int> > &links, int N){
+    std::vector<int> order;
+    sort_link_indices_by_router(links, N, order);
+
+    std::vector< std::pair<int,int> > sorted(links.size());
+    for(std::size_t ii = 0; ii < links.size(); ii++){
+        sorted[ii] = links[order[ii]];
+    }
+    links.swap(sorted);
+}
+
+void DragonFlyFull :: _ArrangeGlobalLinksAbsoluteImproved(std::vector< std::pair<int,int> > &global_links){
+    /*
+    The original scheme: a cursor walks over (dest_node, dest_group), group 
+    fastest, starting at (0, 1). Every source router, in order, takes the 
+    cursor's router as long as it needs global links, unless the router is 
+    in its own group or already has _h links. The cursor moves on after 
+    every try.
+
+    Stepping over full routers one by one made this quadratic for large g.
+    A router never gets un-full, so full cursor positions are skipped for 
+    good through a next-free-position forest (union-find with path halving).
+    Every remaining try either adds a link or hits the source's own group, 
+    which happens at most once per _g positions. Same links, same order.
+    */
+    std::vector<int> node_degree(_N, 0);
+    std::vector<int> next_free(_N + 1);     //position -> itself if not full, else towards the next one. _N is the end.
+    int position, src_router, dst_router, tries;
+
+    for (position = 0; position <= _N; position++){
+        next_free[position] = position;
+    }
+
+    //cursor position of (dest_node, dest_group) is dest_node * _g + dest_group
+    auto router_at = [&](int pos){ return (pos % _g) * _a + pos / _g; };
+
+    auto find_free = [&](int pos){
+        while (next_free[pos] != pos){
+            next_free[pos] = next_free[next_free[pos]];
+            pos = next_free[pos];
+        }
+        return pos;
+    };
+
+    auto mark_full = [&](int router){
+        int pos = (router % _a) * _g + router / _a;
+        next_free[pos] = pos + 1;
+    };
+
+    position = 1;   //dest_group = 1, dest_node = 0
+    for (src_router = 0; src_router < _N; src_router++){
+        tries = 0;
+        while (node_degree[src_router] < _h){
+            position = find_free(position);
+            if (position == _N){
+                position = find_free(0);
+            }
+            dst_router = router_at(position);
+
+            if ((dst_router / _a) != (src_router / _a)){
+                global_links.push_back(std::make_pair(src_router, dst_router));
+                node_degree[src_router] += 1;
+                node_degree[dst_router] += 1;
+                if (node_degree[src_router] == _h){
+                    mark_full(src_router);
+                }
+                if (node_degree[dst_router] == _h){
+                    mark_full(dst_router);
+                }
+                tries = 0;
+            }
+            else if (++tries > _a){
+                //only the own group left with free ports
+                cout << "Error. absolute_improved can't give router " << src_router << " all of its " << _h << " global links. Exiting." << endl;
+                exit(1);
+            }
+
+            position = (position + 1) % _N;
+        }
+    }
+}
+
+static void append_circulant_offsets(std::vector<int> &offsets, int count, int g){
+    /*
+    count group offsets in (+d, -d) pairs, d = 1, 2, .. up to g/2 and then 
+    from 1 again. For even g, d = g/2 is its own negative, so an odd count 
+    can end with a single g/2 (g must be even then).
+    So every offset comes as often as its negative, which the port pairing needs.
+    */
+    int d = 1;
+    while (count >= 2){
+        if (2 * d > g){
+            d = 1;
+        }
+        offsets.push_back(d);
+        offsets.push_back(g - d);
+        count -= 2;
+        d++;
+    }
+    if (count == 1){
+        offsets.push_back(g / 2);
+    }
+}
+
+void DragonFlyFull :: _ArrangeGlobalLinksByOffset(const std::vector<int> &offsets, std::vector< std::pair<int,int> > &global_links){
+    /*
+    offsets[k] is the group the k-th global port of a group goes to, relative
+    to the group: group i, port k -> group (i + offsets[k]) % _g. Port k is 
+    on router k / _h of the group. Same for every group, so shifting the 
+    group IDs maps the network onto itself.
+    
+    The m-th port of group i with offset d is cabled to the m-th port of
+    group i + d with offset _g - d. Each cable is seen from both ends, only the
+    end with the smaller router ID adds it.
+    */
+    std::vector< std::vector<int> > ports_of_offset(_g);
+    std::vector<int> occurrence(offsets.size());
+    std::size_t k;
+    int group, d, partner_port, src_router, dst_router;
+
+    for (k = 0; k < offsets.size(); k++){
+        occurrence[k] = ports_of_offset[offsets[k]].size();
+        ports_of_offset[offsets[k]].push_back(k);
+    }
+
+    for (group = 0; group < _g; group++){
+        for (k = 0; k < offsets.size(); k++){
+            d = offsets[k];
+            partner_port = ports_of_offset[_g - d][occurrence[k]];
+            src_router = group * _a + k / _h;
+            dst_router = ((group + d) % _g) * _a + partner_port / _h;
+            if (src_router < dst_router){
+                global_links.push_back(std::make_pair(src_router, dst_router));
+            }
+        }
+    }
+}
+
+void DragonFlyFull :: _ArrangeGlobalLinksRandom(std::vector< std::pair<int,int> > &global_links){
+    /*
+    Random cabling of all the _N * _h global ports, from its own generator 
+    seeded with df_arrangement_seed, so the traffic random stream is not 
+    touched and the same seed gives the same network.
+
+    Every group pair gets one cable first, so the network has minimal paths
+    between all the groups like the other arrangements (_g <= _a * _h + 1 is
+    checked at construction). Each group's ports are shuffled, and the group
+    pairs are cabled in random order, each taking the next shuffled port of 
+    both groups. The rest of the ports are matched at random. Ports cabled 
+    within a group are swapped with a random other cable until both cables
+    go across groups.
+    */
+    std::mt19937 generator(_arrangement_seed);
+    std::vector< std::vector<int> > group_ports(_g);
+    std::vector<int> next_port(_g, 0);
+    std::vector< std::pair<int,int> > group_pairs;
+    std::vector<int> ports;
+    std::size_t ii, other, tries;
+    int group, other_group, node, jj;
+
+    for (group = 0; group < _g; group++){
+        for (node = group * _a; node < (group + 1) * _a; node++){
+            for (jj = 0; jj < _h; jj++){
+                group_ports[group].push_back(node);
+            }
+        }
+        std::shuffle(group_ports[group].begin(), group_ports[group].end(), generator);
+    }
+
+    for (group = 0; group < _g; group++){
+        for (other_group = group + 1; other_group < _g; other_group++){
+            group_pairs.push_back(std::make_pair(group, other_group));
+        }
+    }
+    std::shuffle(group_pairs.begin(), group_pairs.end(), generator);
+
+    for (ii = 0; ii < group_pairs.size(); ii++){
+        int src_router = group_ports[group_pairs[ii].first][next_port[group_pairs[ii].first]++];
+        int dst_router = group_ports[group_pairs[ii].second][next_port[group_pairs[ii].second]++];
+        global_links.push_back(std::make_pair(std::min(src_router, dst_router), std::max(src_router, dst_router)));
+    }
+
+    //the spare ports, matched at random
+    for (group = 0; group < _g; group++){
+        ports.insert(ports.end(), group_ports[group].begin() + next_port[group], group_ports[group].end());
+    }
+    std::shuffle(ports.begin(), ports.end(), generator);
+
+    std::size_t cables = ports.size() / 2;
+    if (cables == 0){
+        return;
+    }
+    std::uniform_int_distribution<std::size_t> pick_cable(0, cables - 1);
+
+    for (ii = 0; ii < cables; ii++){
+        tries = 0;
+        while ((ports[2 * ii] / _a) == (ports[2 * ii + 1] / _a)){
+            other = pick_cable(generator);
+            if (((ports[2 * ii] / _a) != (ports[2 * other + 1] / _a)) && ((ports[2 * other] / _a) != (ports[2 * ii + 1] / _a))){
+                std::swap(ports[2 * ii + 1], ports[2 * other + 1]);
+            }
+            if (++tries > 100 * cables){
+                cout << "Error! Could not cable the random arrangement without links inside a group. Exiting." << endl;
+                exit(-1);
+            }
+        }
+    }
+
+    for (ii = 0; ii < cables; ii++){
+        global_links.push_back(std::make_pair(std::min(ports[2 * ii], ports[2 * ii + 1]), std::max(ports[2 * ii], ports[2 * ii + 1])));
+    }
 }
 
 void DragonFlyFull :: _BuildGraphForGlobal(string arrangement){
     /*
-    Depending on the arrangement, we can follow different connection schemes.
-    At the moment, we'll just support absolute_improved.
+    Depending on the arrangement, we can follow different connection schemes:
+        absolute_improved:  the original one.
+        relative:           palmtree. Port k of group i goes to group i - k - 1,
+                            repeated while a*h >= g-1, the rest in (+d,-d) pairs.
+        circulant:          ports go to groups i+1, i-1, i+2, i-2, ...
+        random:             one cable per group pair, the rest matched at random. df_arrangement_seed.
+    Arrangements with more global ports than groups to reach get parallel links,
+    which end up as the width of the link.
     */
     
     cout << "_BuilfGraphForGlobal() starts ..." << endl;
@@ -608,216 +1102,408 @@ void DragonFlyFull :: _BuildGraphForGlobal(string arrangement){
     
     
     if (arrangement == "absolute_improved"){
-        std::vector <int> node_degree(_N, 0);   //a vector of length equal to total nodes, initialized to 0
-        
-        int src_node_id;
-        int dst_node_id;
-        
-        int src_group;
-        int src_node;
-        
-        int dest_group = 1;
-        int dest_node = 0;
-        
-        for(src_group = 0; src_group < _g; src_group++){
-            for (src_node = 0; src_node < _a; src_node++){
-                while(node_degree[(_a * src_group) + src_node] < _h){
-                
-                    if ((dest_group != src_group) && (node_degree[(_a * dest_group) + dest_node] < _h)) {
-                        src_node_id = (_a * src_group) + src_node;
-                        dst_node_id = (_a * dest_group) + dest_node; 
-                        
-                        node_degree[src_node_id] += 1;
-                        node_degree[dst_node_id] += 1;
-                        
-                        global_links.push_back(std::make_pair(src_node_id, dst_node_id));
-                    }
-                        
-                    dest_group += 1;
-                    
-                    if (dest_group % _g == 0){
-                        dest_node += 1;
-                        dest_node %= _a;
-                        dest_group %= _g;
+        _ArrangeGlobalLinksAbsoluteImproved(global_links);
+    }
+    
+    else if ((arrangement == "relative") || (arrangement == "circulant") || (arrangement == "random")){
+        if (arrangement == "random"){
+            _ArrangeGlobalLinksRandom(global_links);
+        }
+        else{
+            std::vector<int> offsets;
+            int remaining = _a * _h;
+            
+            if (arrangement == "relative"){
+                for (; remaining >= _g - 1; remaining -= _g - 1){
+                    for (int d = _g - 1; d >= 1; d--){
+                        offsets.push_back(d);
                     }
                 }
-                
             }
+            append_circulant_offsets(offsets, remaining, _g);
+            _ArrangeGlobalLinksByOffset(offsets, global_links);
         }
     }
-    
+
     else{
         cout << "Error. Arrangement unsupported: " << arrangement << endl;
         exit(1);
     }
                 
     //links connected. Test print.
-    //    for(int ii=0; ii < global_links.size(); ii++){
+    //    for(std::size_t ii=0; ii < global_links.size(); ii++){
     //        cout << "link " << ii << " : " << global_links[ii].first << " , " << global_links[ii].second << endl;
     //    }
     
     /*
-        //We have the links. Now check if any link is present multiple times.
-        //We need to assign multiple channels for that link.
-        //For absolute_improved, this won't happen. But for some other arrangement 
-        //scheme this can happen. So better to set up a system that can handle that.
-        
-        //Also, for a link (a,b), we need to check the weight of (b,a) as well,
-        //and need to set the max of two as the weight of both the unidirectional links.
-    */         
-        
-    //get frequency of the links
-    for(std::size_t ii = 0; ii < global_links.size(); ii++){
-        if ( g_global_link_frequency.find(global_links[ii]) != g_global_link_frequency.end() ){
-            g_global_link_frequency[global_links[ii]] += 1;
-        }else{
-            g_global_link_frequency[global_links[ii]] = 1;
+        Each entry of global_links is one cable. Some arrangements put several
+        cables between the same two routers, that router pair then gets a link 
+        of that width, in both directions.
+
+        Orient every cable from the smaller router, sort, and count the runs.
+        Then list both directions and sort again, so the global edges of every
+        g_graph row and every g_inter_group_links bucket come out in 
+        (src, dst) order. Both sorts are counting sorts over router IDs, so 
+        all of this is linear in the no of links.
+    */
+    std::size_t ii, jj;
+    int src, dst, width;
+    int src_group, dst_group;
+
+    for(ii = 0; ii < global_links.size(); ii++){
+        if (global_links[ii].first > global_links[ii].second){
+            std::swap(global_links[ii].first, global_links[ii].second);
         }
     }
-        
-    //frequency counted. Test print.
-    //    for(auto it = g_global_link_frequency.begin(); it!= g_global_link_frequency.end(); it++){
-    //        cout << it->first.first << "," << it->first.second << " -> " << it->second << endl;
-    //    }
+    sort_links_by_router(global_links, _N);
 
-    //go through the list again. For each (a,b), update the frequency of (a,b) and (b,a)
-    //to its max. We do twice the amount of checking as actually needed, but its linear
-    // order and done only once, so no big deal.
-    int freq_a, freq_b, freq_max;
-    for(std::size_t ii=0; ii < global_links.size(); ii++){
-        if (g_global_link_frequency.find(global_links[ii]) != g_global_link_frequency.end()){
-            freq_a = g_global_link_frequency[global_links[ii]];
-        }else{
-            freq_a = 0;
-        }
-    
-        if (g_global_link_frequency.find( std::make_pair( global_links[ii].second, global_links[ii].first) ) != g_global_link_frequency.end()){
-            freq_b = g_global_link_frequency[std::make_pair( global_links[ii].second, global_links[ii].first)];
-        }else{
-            freq_b = 0;
+    std::vector< std::pair<int,int> > directed_links;
+    std::vector<int> cable_width;
+    directed_links.reserve(global_links.size() * 2);
+    for(ii = 0; ii < global_links.size(); ii = jj){
+        for(jj = ii + 1; (jj < global_links.size()) && (global_links[jj] == global_links[ii]); jj++){
         }
-    
-        freq_max = freq_a > freq_b? freq_a : freq_b;
-        
-        g_global_link_frequency[global_links[ii]] = freq_max;
-        g_global_link_frequency[std::make_pair( global_links[ii].second, global_links[ii].first)] = freq_max;
-        
-        //cout <<  global_links[ii].first << " , " << global_links[ii].second << " , " << freq_a << " , " << freq_b << " , " << freq_max << endl;
+        width = jj - ii;
+        directed_links.push_back(global_links[ii]);
+        directed_links.push_back(std::make_pair(global_links[ii].second, global_links[ii].first));
+        cable_width.push_back(width);
+        cable_width.push_back(width);
     }
-            
-    //    cout << "\n both way links: " << endl;
-    //    for(auto it = g_global_link_frequency.begin(); it!= g_global_link_frequency.end(); it++){
-    //        cout << it->first.first << "," << it->first.second << " -> " << it->second << endl;
-    //    }
-        
-    //Links and their weights found. Now populate the graph accordingly.
-    int src, dst, freq;
-    int src_group, dst_group;
-     int ii, jj;
-    for(auto it = g_global_link_frequency.begin(); it != g_global_link_frequency.end(); it++){
-        src = it->first.first;
-        dst = it->first.second;
-        freq = it->second;
-        //cout << src << " , " << dst << " , " << freq << endl;
-            
-        //add it to src's neighbor list
-        for(ii = 0; g_graph[src][ii] != -1; ii++);
-        
-        g_graph[src][ii] = dst;
-        g_link_weights[src][ii] = GLOBAL_LINK_WEIGHT;
-        
-        //        cout << "graph[" << src << "]: ";
-        //        for(ii = 0; ii < _h + _a - 1; ii++){
-        //            cout << g_graph[src][ii] << " ";
-        //        }
-        //        cout << endl;
 
-        //our links are unidirectional. So adding to the destination's neighbor list is not needed.
-        
-        //also, populate the g_inter_group_links vector.
+    //sort indices, so the widths come along
+    std::vector<int> order;
+    sort_link_indices_by_router(directed_links, _N, order);
+
+    //Links and their widths found. Now populate the graph accordingly.
+    std::vector<int> group_pair_of_link;
+    for(ii = 0; ii < order.size(); ii++){
+        src = directed_links[order[ii]].first;
+        dst = directed_links[order[ii]].second;
+        width = cable_width[order[ii]];
+
+        //add it to src's neighbor list. The other direction is its own entry.
+        g_graph.add_edge(src, dst, GLOBAL_LINK_WEIGHT, width);
+
+        //also, count it for g_inter_group_links.
         src_group = src/_a;
         dst_group = dst/_a;
-        
-        for(jj=0; jj < freq; jj++){
-            g_inter_group_links[src_group][dst_group].push_back(std::make_pair(src,dst));
+
+        for(int kk = 0; kk < width; kk++){
+            group_pair_of_link.push_back(src_group * _g + dst_group);
+            g_inter_group_link_offsets[src_group * _g + dst_group + 1] += 1;
         }
     }
-        
-    /*cout << "\nTest printing the graph:" << endl;    
-    print_2d_vector(g_graph);
-    //    cout << "\nTest printing the link weights:" << endl;
-    //    print_2d_vector(g_link_weights);
-    //    
-    cout << "test printing the g_inter_group_links ..." << endl; 
+
+    //bucket the links by group pair. Counting sort, so the (src, dst) order is kept within a bucket.
+    for(ii = 0; ii < (std::size_t)(_g * _g); ii++){
+        g_inter_group_link_offsets[ii + 1] += g_inter_group_link_offsets[ii];
+    }
+    g_inter_group_links.resize(group_pair_of_link.size());
+
+    std::vector<int> fill(g_inter_group_link_offsets.begin(), g_inter_group_link_offsets.end() - 1);
+    std::size_t link_count = 0;
+    for(ii = 0; ii < order.size(); ii++){
+        width = cable_width[order[ii]];
+        for(int kk = 0; kk < width; kk++, link_count++){
+            g_inter_group_links[ fill[group_pair_of_link[link_count]]++ ] = directed_links[order[ii]];
+        }
+    }
+
+    /*
+    cout << "test printing the g_inter_group_links ..." << endl;
     for(int ii = 0; ii<_g; ii++){
         for(int jj = 0; jj<_g; jj++){
             cout << ii << "," << jj << " : ";
-            for (int kk = 0; kk < g_inter_group_links[ii][jj].size(); kk++){
-                cout << "(" << g_inter_group_links[ii][jj][kk].first << "," << g_inter_group_links[ii][jj][kk].second << ")" << " ";
+            for (int kk = g_inter_group_link_offsets[ii*_g + jj]; kk < g_inter_group_link_offsets[ii*_g + jj + 1]; kk++){
+                cout << "(" << g_inter_group_links[kk].first << "," << g_inter_group_links[kk].second << ")" << " ";
             }
             cout << endl;
-            
+
         }
-        
+
     }*/
 
 }
 
-void DragonFlyFull :: _CreatePortMap(){
+void DragonFlyFull :: _CreatePortMap(){
+    /*
+    Assumpiton: all the links are already added to g_graph.
+
+    Lay out the CSR rows, then assign the ports.
+    Each router first has _p ports to its PEs.
+    Then one port per local link, in the order of the rows.
+    Then each global link takes as many ports as its width.
+
+    Local ports need no table afterwards, see local_port_to_node().
+    Global ports are looked up through first_port of the global edges,
+    g_global_port_index finds the edge.
+    */
+
+    int port_count;
+    int node;
+    int local_count;
+
+    g_graph.finalize();
+
+    for (node = 0; node < _N; node++){
+        port_count = _p;    //no fo PEs on eahc router
+        local_count = 0;
+
+        for(DFEdge *edge = g_graph.begin(node); edge != g_graph.end(node); edge++){
+            edge->first_port = port_count;
+
+            if (local_count < _a - 1){
+                //local_port_to_node() and the routing functions rely on this layout
+                if ((edge->weight != LOCAL_LINK_WEIGHT) || (port_count != local_port_to_node(node, edge->dst))){
+                    cout << "Error! Local port layout mismatch for " << node << " -> " << edge->dst << " . Exiting." << endl;
+                    exit(-1);
+                }
+                local_count += 1;
+            }
+
+            port_count += edge->width;
+        }
+    }
+
+    g_global_port_index.build(g_graph, _a - 1);
+
+    //test print the ports
+    //    for (node = 0; node < _N; node++){
+    //        for(const DFEdge *edge = g_graph.begin(node); edge != g_graph.end(node); edge++){
+    //            cout << node << " -> " << edge->dst << " , ( " << edge->first_port << "," << edge->first_port + edge->width - 1 << ")" << endl;
+    //        }
+    //    }
+}
+    
+    
+void DragonFlyFull :: _WriteTopology(const string &file_name){
+    /*
+    Write the router graph as text, the input of PathSetOptimizer/vlb_path_optimizer.py:
+        dragonfly_full_topology 1
+        a g h p N
+        topology_hash <16 hex digits>
+        src dst weight width      (one line per directed link, in g_graph row order)
+    The hash is df_topology_hash(g_graph). The optimizer copies it into the
+    i-node table, so the table can only be loaded for the same graph.
+    */
+    ofstream out(file_name);
+
+    if (out.is_open() == false){
+        cout << "Error! Can't open df_topology_file " << file_name << " . Exiting." << endl;
+        exit(-1);
+    }
+
+    out << "dragonfly_full_topology 1" << endl;
+    out << _a << " " << _g << " " << _h << " " << _p << " " << _N << endl;
+    out << "topology_hash " << std::hex << std::setw(16) << std::setfill('0') << df_topology_hash(g_graph) << std::dec << endl;
+    for (int node = 0; node < _N; node++){
+        for (const DFEdge *edge = g_graph.begin(node); edge != g_graph.end(node); edge++){
+            out << node << " " << edge->dst << " " << edge->weight << " " << edge->width << "\n";
+        }
+    }
+
+    cout << "topology written to " << file_name << endl;
+}
+    
+//sections of the constructor snapshot
+enum DFSnapshotSection {
+    DF_SNAP_DJKSTRA_INFO = 1,   //g_djkstra_rows, g_djkstra_shift, g_djkstra_sample_paths, path pool is full
+    DF_SNAP_DISTANCE,           //g_djkstra_table arrays
+    DF_SNAP_PARENT_OFFSETS,
+    DF_SNAP_PARENTS,
+    DF_SNAP_PATH_COUNTS,
+    DF_SNAP_POOL_CELL_OFFSETS,  //g_djkstra_path_pool arrays, only if it is full
+    DF_SNAP_POOL_PATH_OFFSETS,
+    DF_SNAP_POOL_ROUTERS,
+    DF_SNAP_ONE_HOP_BITS,
+    DF_SNAP_TWO_HOP_BITS,
+    DF_SNAP_ONE_HOP_OFFSETS,    //offsets and items of the DFFlatLists
+    DF_SNAP_ONE_HOP_NODES,
+    DF_SNAP_TWO_HOP_OFFSETS,
+    DF_SNAP_TWO_HOP_NODES,
+    DF_SNAP_COMMON_OFFSETS,
+    DF_SNAP_COMMON_NODES
+};
+
+string DragonFlyFull :: _SnapshotFileName(uint64_t &key){
+    /*
+    The key covers every parameter the snapshot tables depend on. The graph
+    itself is checked through its topology hash on top of that, so a change
+    in how the links are arranged can't pick up a stale snapshot either.
+    The djkstra engine is part of it too. Both engines sort the parent lists
+    (sort_parents()), so they give the same tables, but the path pool and the
+    path sampling follow the parent order, so a snapshot is only ever reused
+    by the engine that wrote it.
+    */
+#ifdef DJKSTRA_BUCKET_QUEUE
+    const char *djkstra_engine = "bucket_queue";
+#else
+    const char *djkstra_engine = "heap";
+#endif
+    ostringstream parameters;
+    parameters << "dragonfly_full a " << _a << " g " << _g << " h " << _h << " p " << _p
+        << " arrangement " << _arrangement << " seed " << _arrangement_seed
+        << " weights " << LOCAL_LINK_WEIGHT << " " << GLOBAL_LINK_WEIGHT
+        << " djkstra_group_symmetry " << _djkstra_group_symmetry 
+        << " djkstra_path_selection " << _djkstra_path_selection
+        << " djkstra_path_pool_mb " << _djkstra_path_pool_mb
+        << " djkstra_engine " << djkstra_engine;
+    key = df_snapshot_key(parameters.str());
+
+    ostringstream file_name;
+    file_name << _snapshot_dir << "/df_" << _a << "_" << _g << "_" << _h << "_" << _p << "_" << _arrangement 
+        << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".snapshot";
+    return file_name.str();
+}
+
+static bool view_snapshot_lists(uint32_t offsets_id, uint32_t items_id, std::size_t num_rows, DFFlatLists<int> &lists, bool attach){
+    /*
+    Checks that the two sections hold num_rows lists, then points lists at
+    them if attach is set.
+    */
+    std::size_t n_offsets, n_items;
+    const uint32_t *offsets = g_snapshot.section<uint32_t>(offsets_id, n_offsets);
+    const int *items = g_snapshot.section<int>(items_id, n_items);
+
+    if ((offsets == NULL) || (items == NULL) || (n_offsets != num_rows + 1) || (n_items != offsets[num_rows])){
+        return false;
+    }
+    if (attach){
+        lists.offsets.view(offsets, n_offsets);
+        lists.items.view(items, n_items);
+    }
+    return true;
+}
+
+bool DragonFlyFull :: _LoadSnapshot(){
     /*
-    Assumpiton: the graph is already generated. g_global_link_frequency is already populated.
-    
-    Each PE has a weight of 1.    
-    Each local link has a width of 1. 
-    Each global link has a width equal to its frequency.
-    Populate the g_port_map accordingly.
-    
+    Map the snapshot of this topology and point the djkstra table, the path
+    pool, the neighbor sets and the common node lists at its sections. 
+    Nothing is copied out, so every run that maps the same file shares one
+    physical copy of them.
+    Returns false if there is no usable snapshot, the caller computes then.
     */
-        
-    //for each node
-     int port_count;
-    
-    std::size_t node;
-    int dst;
-    
-    int ii;
-    int width;
-    
-    for (node = 0; node < g_graph.size(); node++){
-        //first go through the local nodes
-        port_count = _p;    //no fo PEs on eahc router
-        
-        for(ii = 0; ii < _a - 1; ii++ ){
-            dst = g_graph[node][ii];
-            g_link_widths[node][ii] = 1;    //by default, all local links has a width of 1
-            g_port_map[std::make_pair(node,dst)] = std::make_pair(port_count, port_count);
-            port_count += 1;
-        }
-    
-        //now go through the global nodes
-        for(ii = _a - 1 ; ii < _a - 1 + _h; ii++){
-            dst = g_graph[node][ii];
-            width = g_global_link_frequency[std::make_pair(node, dst)];
-            
-            g_link_widths[node][ii] = width;
-            g_port_map[std::make_pair(node,dst)] = std::make_pair(port_count, port_count+width-1);
-            
-            port_count += width;
+    if (_snapshot_dir == ""){
+        return false;
+    }
+
+    uint64_t key;
+    string file_name = _SnapshotFileName(key);
+    string reason;
+
+    if (g_snapshot.open(file_name, key, df_topology_hash(g_graph), reason) == false){
+        cout << "snapshot " << file_name << " not used: " << reason << endl;
+        return false;
+    }
+
+    std::size_t n_info, n_distance, n_parent_offsets, n_parents, n_path_counts;
+    std::size_t n_pool_cells, n_pool_paths, n_pool_routers, n_one_hop, n_two_hop;
+    const int32_t *info = g_snapshot.section<int32_t>(DF_SNAP_DJKSTRA_INFO, n_info);
+    const uint8_t *distance = g_snapshot.section<uint8_t>(DF_SNAP_DISTANCE, n_distance);
+    const uint32_t *parent_offsets = g_snapshot.section<uint32_t>(DF_SNAP_PARENT_OFFSETS, n_parent_offsets);
+    const uint16_t *parents = g_snapshot.section<uint16_t>(DF_SNAP_PARENTS, n_parents);
+    const uint32_t *path_counts = g_snapshot.section<uint32_t>(DF_SNAP_PATH_COUNTS, n_path_counts);
+    const uint32_t *pool_cell_offsets = g_snapshot.section<uint32_t>(DF_SNAP_POOL_CELL_OFFSETS, n_pool_cells);
+    const uint32_t *pool_path_offsets = g_snapshot.section<uint32_t>(DF_SNAP_POOL_PATH_OFFSETS, n_pool_paths);
+    const uint16_t *pool_routers = g_snapshot.section<uint16_t>(DF_SNAP_POOL_ROUTERS, n_pool_routers);
+    const uint64_t *one_hop_bits = g_snapshot.section<uint64_t>(DF_SNAP_ONE_HOP_BITS, n_one_hop);
+    const uint64_t *two_hop_bits = g_snapshot.section<uint64_t>(DF_SNAP_TWO_HOP_BITS, n_two_hop);
+
+    //sizes have to agree with each other before anything points into the file
+    std::size_t words = (_N + 63) / 64;
+    std::size_t cells = 0;
+    bool ok = (info != NULL) && (n_info == 4) && (info[0] > 0) && (info[0] <= _N);
+    if (ok){
+        cells = (std::size_t)info[0] * _N;
+        ok = (distance != NULL) && (n_distance == cells) && (path_counts != NULL) && (n_path_counts == cells)
+            && (parent_offsets != NULL) && (n_parent_offsets == cells + 1) && (parents != NULL) && (n_parents == parent_offsets[cells])
+            && (one_hop_bits != NULL) && (n_one_hop == _N * words) && (two_hop_bits != NULL) && (n_two_hop == _N * words)
+            && view_snapshot_lists(DF_SNAP_ONE_HOP_OFFSETS, DF_SNAP_ONE_HOP_NODES, _N, one_hop_neighbors_vector, false)
+            && view_snapshot_lists(DF_SNAP_TWO_HOP_OFFSETS, DF_SNAP_TWO_HOP_NODES, _N, two_hop_neighbors_vector, false)
+            && view_snapshot_lists(DF_SNAP_COMMON_OFFSETS, DF_SNAP_COMMON_NODES, (std::size_t)_g * _g, g_group_pair_vs_common_nodes, false);
+    }
+    if (ok && (info[3] == 1)){
+        ok = (pool_cell_offsets != NULL) && (n_pool_cells == cells + 1) 
+            && (pool_path_offsets != NULL) && (n_pool_paths == (std::size_t)pool_cell_offsets[cells] + 1) 
+            && (pool_routers != NULL) && (n_pool_routers == pool_path_offsets[n_pool_paths - 1]);
+    }
+    if (ok == false){
+        cout << "snapshot " << file_name << " not used: damaged" << endl;
+        g_snapshot.close();
+        return false;
+    }
+
+    g_djkstra_rows = info[0];
+    g_djkstra_shift = info[1];
+    g_djkstra_sample_paths = (info[2] == 1);
+
+    g_djkstra_table.num_rows = g_djkstra_rows;
+    g_djkstra_table.num_nodes = _N;
+    g_djkstra_table.distance.view(distance, n_distance);
+    g_djkstra_table.parent_offsets.view(parent_offsets, n_parent_offsets);
+    g_djkstra_table.parents.view(parents, n_parents);
+    g_djkstra_table.path_counts.view(path_counts, n_path_counts);
+
+    std::size_t pool_budget = (std::size_t)_djkstra_path_pool_mb * 1024 * 1024;
+    if (g_djkstra_sample_paths == false){
+        if (info[3] == 1){
+            g_djkstra_path_pool.view(g_djkstra_table, pool_budget, pool_cell_offsets, pool_path_offsets, n_pool_paths - 1, pool_routers, n_pool_routers);
+        }else{
+            g_djkstra_path_pool.use_cache(g_djkstra_table, pool_budget);
         }
     }
-            
-    //test print g_link_widths
-    //cout << "\nTest printing the link widths:" << endl;
-    //print_2d_vector(g_link_widths);
-        
-    //test print the g_port_map
-    //    for (auto it = g_port_map.begin(); it != g_port_map.end(); it++){
-    //            cout << "(" << it->first.first << "," << it->first.second << ") , ( " << it->second.first << "," << it->second.second << ")  ";  
-    //            cout << endl;  
-    //    }
+
+    one_hop_neighbors_bits.view(_N, _N, one_hop_bits);
+    two_hop_neighbors_bits.view(_N, _N, two_hop_bits);
+    view_snapshot_lists(DF_SNAP_ONE_HOP_OFFSETS, DF_SNAP_ONE_HOP_NODES, _N, one_hop_neighbors_vector, true);
+    view_snapshot_lists(DF_SNAP_TWO_HOP_OFFSETS, DF_SNAP_TWO_HOP_NODES, _N, two_hop_neighbors_vector, true);
+    view_snapshot_lists(DF_SNAP_COMMON_OFFSETS, DF_SNAP_COMMON_NODES, (std::size_t)_g * _g, g_group_pair_vs_common_nodes, true);
+
+    cout << "snapshot " << file_name << " mapped, " << g_snapshot.bytes() << " bytes. djkstra rows: " << g_djkstra_rows << " of " << _N << endl;
+    return true;
 }
-    
-    
+
+bool DragonFlyFull :: _WriteSnapshot(){
+    /*
+    Save what _LoadSnapshot() needs. A failed write only costs the next run
+    the recomputation, so it is not an error. Returns true if written.
+    */
+    if (_snapshot_dir == ""){
+        return false;
+    }
+
+    uint64_t key;
+    string file_name = _SnapshotFileName(key);
+    DFSnapshotWriter writer;
+
+    int32_t info[4] = {g_djkstra_rows, g_djkstra_shift, g_djkstra_sample_paths ? 1 : 0, g_djkstra_path_pool.is_full() ? 1 : 0};
+    writer.add(DF_SNAP_DJKSTRA_INFO, info, 4);
+    writer.add(DF_SNAP_DISTANCE, g_djkstra_table.distance.data(), g_djkstra_table.distance.size());
+    writer.add(DF_SNAP_PARENT_OFFSETS, g_djkstra_table.parent_offsets.data(), g_djkstra_table.parent_offsets.size());
+    writer.add(DF_SNAP_PARENTS, g_djkstra_table.parents.data(), g_djkstra_table.parents.size());
+    writer.add(DF_SNAP_PATH_COUNTS, g_djkstra_table.path_counts.data(), g_djkstra_table.path_counts.size());
+    if (g_djkstra_path_pool.is_full()){
+        writer.add(DF_SNAP_POOL_CELL_OFFSETS, g_djkstra_path_pool.cell_offsets().data(), g_djkstra_path_pool.cell_offsets().size());
+        writer.add(DF_SNAP_POOL_PATH_OFFSETS, g_djkstra_path_pool.path_offsets().data(), g_djkstra_path_pool.path_offsets().size());
+        writer.add(DF_SNAP_POOL_ROUTERS, g_djkstra_path_pool.routers().data(), g_djkstra_path_pool.routers().size());
+    }
+    writer.add(DF_SNAP_ONE_HOP_BITS, one_hop_neighbors_bits.data(), one_hop_neighbors_bits.bytes() / sizeof(uint64_t));
+    writer.add(DF_SNAP_TWO_HOP_BITS, two_hop_neighbors_bits.data(), two_hop_neighbors_bits.bytes() / sizeof(uint64_t));
+    writer.add(DF_SNAP_ONE_HOP_OFFSETS, one_hop_neighbors_vector.offsets.data(), one_hop_neighbors_vector.offsets.size());
+    writer.add(DF_SNAP_ONE_HOP_NODES, one_hop_neighbors_vector.items.data(), one_hop_neighbors_vector.items.size());
+    writer.add(DF_SNAP_TWO_HOP_OFFSETS, two_hop_neighbors_vector.offsets.data(), two_hop_neighbors_vector.offsets.size());
+    writer.add(DF_SNAP_TWO_HOP_NODES, two_hop_neighbors_vector.items.data(), two_hop_neighbors_vector.items.size());
+    writer.add(DF_SNAP_COMMON_OFFSETS, g_group_pair_vs_common_nodes.offsets.data(), g_group_pair_vs_common_nodes.offsets.size());
+    writer.add(DF_SNAP_COMMON_NODES, g_group_pair_vs_common_nodes.items.data(), g_group_pair_vs_common_nodes.items.size());
+
+    if (writer.write(file_name, key, df_topology_hash(g_graph))){
+        cout << "snapshot written to " << file_name << endl;
+        return true;
+    }
+    cout << "Warning! Can't write snapshot " << file_name << " , the next run will compute the tables again." << endl;
+    return false;
+}
+
 void DragonFlyFull :: _generate_two_hop_neighbors(){
     /*
     This one will be needed for tiered routing.
@@ -836,84 +1522,65 @@ void DragonFlyFull :: _generate_two_hop_neighbors(){
             - Add the dst to the list of all src_group_neighbors.
             
             
-        - After the sets are populated, generate the vectors.
+        - After the bitsets are populated, generate the vectors. Walking the bits
+          gives them already sorted.
     */
     
     cout << "\ninside _generate_two_hop_neighbors()" << endl;
     
     //alocate the arrays.
-    //std::vector < std::unordered_set <int> > two_hop_neighbors_set;
-    //std::vector < std::vector <int> > two_hop_neighbors_vector;
-    two_hop_neighbors_set.resize(_N, std::unordered_set<int>());
-    two_hop_neighbors_vector.resize(_N, std::vector<int>());
+    two_hop_neighbors_bits.reset(_N, _N);
+    std::vector < std::vector <int> > two_hop_lists(_N);
     
     
-    std::unordered_set<int>::iterator it;
-    
     //here are all the global links
-    //std::vector< std::vector < std::vector <std::pair<int,int> > > > g_inter_group_links;
+    //std::vector< std::pair<int,int> > g_inter_group_links;
     std::size_t ii, jj, kk;
     int src, dst;
     int src_group, dst_group;
     int src_neighbor, dst_neighbor;
     
-    for(ii = 0; ii< g_inter_group_links.size(); ii++){
-        for(jj = 0; jj < g_inter_group_links[ii].size(); jj++){
-            //cout << "src: " << ii << "  dst: " << jj << " -> " << endl;
-            for(kk = 0; kk < g_inter_group_links[ii][jj].size(); kk++){
-                //cout << "(" << g_inter_group_links[ii][jj][kk].first << " , " << g_inter_group_links[ii][jj][kk].second << ")" << "    ";
-                
-                src = g_inter_group_links[ii][jj][kk].first;
-                dst = g_inter_group_links[ii][jj][kk].second;
-                
-                src_group = src / _a;
-                dst_group = dst / _a;
-                
-                //cout << "src: " << src << "  dst: " << dst << "  src_group: " << src_group << "  dst_group: " << dst_group << endl;
-                
-                //cout << "other nodes in src_group: " << endl;
-                for(src_neighbor = src_group * _a + 0; src_neighbor < (src_group * _a + _a); src_neighbor++ ){
-                    //cout << src_neighbor << " ";
-                    
-                    two_hop_neighbors_set[dst].insert(src_neighbor);
-                    
-                    two_hop_neighbors_set[src_neighbor].insert(dst);
-                }
-                //cout << endl;
-                
-                //cout << "other nodes in dst_group: " << endl;
-                for(dst_neighbor = dst_group * _a + 0; dst_neighbor < (dst_group * _a + _a); dst_neighbor++ ){
-                    //cout << dst_neighbor << " ";
-                    two_hop_neighbors_set[src].insert(dst_neighbor);
-                    two_hop_neighbors_set[dst_neighbor].insert(src);
-                }
-                //cout << endl;
-                
-            }
-            //cout << endl;
-                
+    for(kk = 0; kk < g_inter_group_links.size(); kk++){
+        //cout << "(" << g_inter_group_links[kk].first << " , " << g_inter_group_links[kk].second << ")" << "    ";
+
+        src = g_inter_group_links[kk].first;
+        dst = g_inter_group_links[kk].second;
+        
+        src_group = src / _a;
+        dst_group = dst / _a;
+        
+        //cout << "src: " << src << "  dst: " << dst << "  src_group: " << src_group << "  dst_group: " << dst_group << endl;
+        
+        //cout << "other nodes in src_group: " << endl;
+        for(src_neighbor = src_group * _a + 0; src_neighbor < (src_group * _a + _a); src_neighbor++ ){
+            //cout << src_neighbor << " ";
+            
+            two_hop_neighbors_bits.set(dst, src_neighbor);
+            
+            two_hop_neighbors_bits.set(src_neighbor, dst);
         }
-    }
-    
-    //now populate the vector 
-    for(ii = 0; ii < _N; ii++){
-        //cout << "node " << ii << " : " << "neighbors: " << two_hop_neighbors_set[ii].size() << " -> " ;
-        for(it = two_hop_neighbors_set[ii].begin(); it != two_hop_neighbors_set[ii].end(); it++){
-            //cout << *it << " ";
-            two_hop_neighbors_vector[ii].push_back(*it);
+        //cout << endl;
+        
+        //cout << "other nodes in dst_group: " << endl;
+        for(dst_neighbor = dst_group * _a + 0; dst_neighbor < (dst_group * _a + _a); dst_neighbor++ ){
+            //cout << dst_neighbor << " ";
+            two_hop_neighbors_bits.set(src, dst_neighbor);
+            two_hop_neighbors_bits.set(dst_neighbor, src);
         }
         //cout << endl;
     }
     
-    //sort the vector
+    //now populate the vector, sorted
     for(ii = 0; ii < _N; ii++){
-        std::sort(two_hop_neighbors_vector[ii].begin(), two_hop_neighbors_vector[ii].end());
+        two_hop_lists[ii].reserve(two_hop_neighbors_bits.count(ii));
+        df_bits_to_vector(two_hop_neighbors_bits.row(ii), two_hop_neighbors_bits.words(), two_hop_lists[ii]);
     }
+    two_hop_neighbors_vector.own(two_hop_lists);
     
     //print the vector 
     //    cout << "\nafter sorting: " << endl;
     //    for(ii = 0; ii < _N; ii++){
-    //        cout << "node " << ii << " : " << "neighbors: " << two_hop_neighbors_set[ii].size() << " -> " ;
+    //        cout << "node " << ii << " : " << "neighbors: " << two_hop_neighbors_vector[ii].size() << " -> " ;
     //        for(jj = 0; jj < two_hop_neighbors_vector[ii].size(); jj++){
     //            cout << two_hop_neighbors_vector[ii][jj] << " ";
     //        }
@@ -939,43 +1606,31 @@ void DragonFlyFull :: _generate_one_hop_neighbors(){
     
     std::size_t ii, jj, kk;
     int src, dst;
-    std::unordered_set<int>::iterator it;
     
     //allocate data structures 
-    one_hop_neighbors_set.resize(_N, std::unordered_set<int>() );
-    one_hop_neighbors_vector.resize(_N, std::vector<int>() );
+    one_hop_neighbors_bits.reset(_N, _N);
+    std::vector < std::vector <int> > one_hop_lists(_N);
     
     //go through the links
-    for(ii = 0; ii< g_inter_group_links.size(); ii++){
-        for(jj = 0; jj < g_inter_group_links[ii].size(); jj++){
-            //cout << "src_grp: " << ii << "  dst_grp: " << jj << " -> " << endl;
-            for(kk = 0; kk < g_inter_group_links[ii][jj].size(); kk++){
-                //cout << "(" << g_inter_group_links[ii][jj][kk].first << " , " << g_inter_group_links[ii][jj][kk].second << ")" << "    ";
-                
-                src = g_inter_group_links[ii][jj][kk].first;
-                dst = g_inter_group_links[ii][jj][kk].second;
-                //cout << src << " , " << dst << endl;
-                
-                one_hop_neighbors_set[src].insert(dst);
-                one_hop_neighbors_set[dst].insert(src);
-            }
-        }
+    for(kk = 0; kk < g_inter_group_links.size(); kk++){
+        //cout << "(" << g_inter_group_links[kk].first << " , " << g_inter_group_links[kk].second << ")" << "    ";
+
+        src = g_inter_group_links[kk].first;
+        dst = g_inter_group_links[kk].second;
+        //cout << src << " , " << dst << endl;
+
+        one_hop_neighbors_bits.set(src, dst);
+        one_hop_neighbors_bits.set(dst, src);
     }
     
-    //now generate vectors from unordered_set
+    //now generate the sorted vectors from the bitsets
     for (ii = 0; ii < _N; ii++ ){
-        for (it = one_hop_neighbors_set[ii].begin(); it != one_hop_neighbors_set[ii].end(); it++){
-            one_hop_neighbors_vector[ii].push_back(*it);
-        }
-    }
-    
-    //now sort the vectors
-    for (ii = 0; ii < _N; ii++){
-        std::sort(one_hop_neighbors_vector[ii].begin(), one_hop_neighbors_vector[ii].end());
+        df_bits_to_vector(one_hop_neighbors_bits.row(ii), one_hop_neighbors_bits.words(), one_hop_lists[ii]);
     }
+    one_hop_neighbors_vector.own(one_hop_lists);
     //print the vector 
     /*for(ii = 0; ii < _N; ii++){
-        cout << "node " << ii << " : " << "neighbors: " << one_hop_neighbors_set[ii].size() << " -> " ;
+        cout << "node " << ii << " : " << "neighbors: " << one_hop_neighbors_vector[ii].size() << " -> " ;
         for(jj = 0; jj < one_hop_neighbors_vector[ii].size(); jj++){
             cout << one_hop_neighbors_vector[ii][jj] << " ";
         }
@@ -1013,16 +1668,18 @@ void DragonFlyFull :: _generate_common_neighbors_for_group_pair(){
     //pair<int,int> vs vector<vector<int>>
     std::unordered_map < std::pair<int, int>, std::vector <std::vector <int> >, pair_hash > combination_cash;
 
-    std::pair<int,int> group_pair;
     std::vector< std::vector<int> > combos;
 
+    //one list per group pair, s*g + d. Flattened into g_group_pair_vs_common_nodes at the end.
+    std::vector< std::vector<int> > common_nodes(_g * _g);
+
     //go through the graph
     for(node = 0; node < _N; node ++){
         
         //cout << "node: " << node << endl; 
 
         start = _a - 1;
-        end = g_graph[node].size();
+        end = g_graph.degree(node);
         len = end - start;
 
         //for combinations we need cash of type pair<int,int> vs vector<vector<int>>
@@ -1038,35 +1695,24 @@ void DragonFlyFull :: _generate_common_neighbors_for_group_pair(){
         
         //generate group pair for each combo
         for (ii = 0; ii < combos.size(); ii++){
-            src_node = g_graph[node][start + combos[ii][0]];
-            dst_node = g_graph[node][start + combos[ii][1]];
+            src_node = g_graph.begin(node)[start + combos[ii][0]].dst;
+            dst_node = g_graph.begin(node)[start + combos[ii][1]].dst;
             src_group = src_node / _a;
             dst_group = dst_node / _a;
 
-            group_pair = std::make_pair(src_group, dst_group);
-
-            if (g_group_pair_vs_common_nodes.find(group_pair) != g_group_pair_vs_common_nodes.end()){
-                g_group_pair_vs_common_nodes[group_pair].push_back(node);   
-            }else{
-                g_group_pair_vs_common_nodes[group_pair] = {node};
-            }
-
-            group_pair = std::make_pair(dst_group, src_group);
-
-            if (g_group_pair_vs_common_nodes.find(group_pair) != g_group_pair_vs_common_nodes.end()){
-                g_group_pair_vs_common_nodes[group_pair].push_back(node);   
-            }else{
-                g_group_pair_vs_common_nodes[group_pair] = {node};
-            }            
+            common_nodes[src_group * _g + dst_group].push_back(node);
+            common_nodes[dst_group * _g + src_group].push_back(node);
         }
     }
 
+    g_group_pair_vs_common_nodes.own(common_nodes);
+
     // cout << "g_group_pair_vs_common_nodes contents: " << endl;
     
-    // for (auto it = g_group_pair_vs_common_nodes.begin(); it != g_group_pair_vs_common_nodes.end(); it++){
-    //     cout << it->first.first << "," << it->first.second << " : ";
-    //     for(ii = 0 ; ii < it->second.size(); ii++){
-    //         cout << it->second[ii] << " ";
+    // for (int pair = 0; pair < _g * _g; pair++){
+    //     cout << pair / _g << "," << pair % _g << " : ";
+    //     for(ii = 0 ; ii < g_group_pair_vs_common_nodes[pair].size(); ii++){
+    //         cout << g_group_pair_vs_common_nodes[pair][ii] << " ";
     //     }
     //     cout << endl;
     // }
@@ -1074,79 +1720,131 @@ void DragonFlyFull :: _generate_common_neighbors_for_group_pair(){
     // cout << "leaving _generate_common_neighbor_nodes_for_group_pair()" << endl;
 }
 
+#define DF_QUALITY_REPORT_PAIRS 4096
 
-    
-    
-void DragonFlyFull :: RegisterRoutingFunctions(){
-    cout << "inside _RegisterRoutingFunctions() ..." << endl;
+void DragonFlyFull :: _ReportTopologyQuality(){
+    /*
+    Printed at construction, to compare arrangements under the same routing code:
+        - global links across a cut of the groups into two halves of consecutive
+          groups, worst and best over all g rotations of the cut. 
+        - group pairs without a direct global link. Routing functions with df_min 
+          paths (min, vlb, UGAL_L, ..) need one for every pair, the djkstra
+          based ones don't.
+        - no of three hop and four hop i-nodes per router pair in different
+          groups, over at most DF_QUALITY_REPORT_PAIRS evenly spaced pairs.
+
+    Which half a group x is in for the cut starting at group s: x is in 
+    [s, s + g/2) iff s is in [x - g/2 + 1, x]. So every group pair adds its 
+    links to a cyclic range of cuts, and a difference array over s gives
+    all g cuts in one pass over the group pairs.
+    */
+    int half = _g / 2;
+    int x, y, d, links, s;
+    long long total_links = 0;
+    int unconnected_group_pairs = 0;
+    std::vector<long long> diff(_g + 1, 0);
+
+    //add value to the cuts [start, start + length), cyclic
+    auto add_cuts = [&](int start, int length, long long value){
+        start = ((start % _g) + _g) % _g;
+        if (start + length <= _g){
+            diff[start] += value;
+            diff[start + length] -= value;
+        }else{
+            diff[start] += value;
+            diff[_g] -= value;
+            diff[0] += value;
+            diff[start + length - _g] -= value;
+        }
+    };
+
+    for (x = 0; x < _g; x++){
+        for (y = x + 1; y < _g; y++){
+            links = g_inter_group_link_offsets[x * _g + y + 1] - g_inter_group_link_offsets[x * _g + y];
+            if (links == 0){
+                unconnected_group_pairs += 1;
+                continue;
+            }
+            total_links += links;
+            if (half == 0){
+                continue;
+            }
 
-    gRoutingFunctionMap["min_dragonflyfull"] = &min_dragonflyfull;
-    gRoutingFunctionMap["min_djkstra_dragonflyfull"] = &min_djkstra_dragonflyfull;
-    
-    gRoutingFunctionMap["vlb_dragonflyfull"] = &vlb_dragonflyfull;
-    gRoutingFunctionMap["vlb_restricted_src_only_dragonflyfull"] = &vlb_dragonflyfull;
-    gRoutingFunctionMap["vlb_restricted_src_and_dst_dragonflyfull"] = &vlb_dragonflyfull;
-    
-                    //Variation of different versions of VLB (regular and
-                    // restricted) is done
-                    // through the same mother VLB function. Internally, path 
-                    // selection options are toggled by the global switch
-                    // g_routing_mode. The value of the switch is set in the
-                    //the function _setRoutingMode().
-    gRoutingFunctionMap["vlb_four_hop_restricted_dragonflyfull"] = &vlb_dragonflyfull;
-                    //This is even more restricted than vlb_restricted.
-                    //The maximum allowed length for vlb paths are four hops.
-    gRoutingFunctionMap["vlb_four_hop_some_five_hop_restricted_dragonflyfull"] = &vlb_dragonflyfull;
-    
+            //cut counts a link if exactly one end is in: in(x) + in(y) - 2 in(x) in(y)
+            add_cuts(x - half + 1, half, links);
+            add_cuts(y - half + 1, half, links);
+            d = y - x;
+            if (d < half){
+                add_cuts(y - half + 1, half - d, -2 * links);
+            }
+            if (_g - d < half){
+                add_cuts(x - half + 1, half - (_g - d), -2 * links);
+            }
+        }
+    }
 
+    long long cut = 0, min_cut = total_links, max_cut = 0;
+    for (s = 0; s < _g; s++){
+        cut += diff[s];
+        min_cut = std::min(min_cut, cut);
+        max_cut = std::max(max_cut, cut);
+    }
 
-    gRoutingFunctionMap["UGAL_L_dragonflyfull"] = &UGAL_dragonflyfull;
-    
-    gRoutingFunctionMap["UGAL_L_two_hop_dragonflyfull"] = &UGAL_dragonflyfull;
-                    //Variation of different versions of UGAL (L and G) is done
-                    //through the same mother UGAL function. Internally, path 
-                    // selection options are toggled by the global switch
-                    // g_routing_mode. The value of the switch is set in the
-                    //the function _setRoutingMode().
+    //i-nodes of sampled router pairs
+    long long pairs = (long long)_N * (_N - _a);
+    long long stride = std::max(1LL, pairs / DF_QUALITY_REPORT_PAIRS);
+    int words = two_hop_neighbors_bits.words();
+    std::vector<uint64_t> bits(words), scratch(words);
+    int src, dst, count;
+    int min_three = _N, max_three = 0, min_four = _N, max_four = 0;
+    long long sum_three = 0, sum_four = 0, sampled = 0, no_three_hop = 0;
 
-    gRoutingFunctionMap["UGAL_L_restricted_src_only_dragonflyfull"] = &UGAL_dragonflyfull;
-    gRoutingFunctionMap["UGAL_L_restricted_src_and_dst_dragonflyfull"] = &UGAL_dragonflyfull;
-        //Both restricted and two_hop use intermediate nodes that lead to 
-        //shorter paths. 
-        //Difference is, two_hop uses min_df paths, and restricted uses
-        //djkstra paths.
-    gRoutingFunctionMap["UGAL_L_four_hop_restricted_dragonflyfull"] = &UGAL_dragonflyfull;
-    
-    gRoutingFunctionMap["UGAL_L_three_hop_restricted_dragonflyfull"] = &UGAL_dragonflyfull;
-        
+    for (long long pair = 0; pair < pairs; pair += stride){
+        src = pair / (_N - _a);
+        dst = pair % (_N - _a);
+        if (dst >= (src / _a) * _a){
+            dst += _a;  //skip src's group
+        }
 
-    gRoutingFunctionMap["UGAL_L_threshold_dragonflyfull"] = &UGAL_dragonflyfull;
-    
-    gRoutingFunctionMap["UGAL_L_four_hop_some_five_hop_restricted_dragonflyfull"] = &UGAL_dragonflyfull;
-    
-    gRoutingFunctionMap["UGAL_G_dragonflyfull"] = &UGAL_dragonflyfull;
-                    //UGAL_G and Ugal_L both implemented through the same UGAL function.
-                    //The difference is only in the final min vs vlb path choice decision,
-                    //which is controlled by a global switch g_ugal_local_vs_global_switch.
-                    //The value of the switch is set in the function _setRoutingMode().
-    gRoutingFunctionMap["UGAL_G_restricted_src_only_dragonflyfull"] = &UGAL_dragonflyfull;
-    gRoutingFunctionMap["UGAL_G_restricted_src_and_dst_dragonflyfull"] = &UGAL_dragonflyfull;
+        three_hop_candidate_bits(src, dst, bits.data(), scratch.data());
+        count = df_bits_popcount(bits.data(), words);
+        min_three = std::min(min_three, count);
+        max_three = std::max(max_three, count);
+        sum_three += count;
+        no_three_hop += (count == 0);
 
-    gRoutingFunctionMap["UGAL_G_four_hop_restricted_dragonflyfull"] = &UGAL_dragonflyfull;
-    gRoutingFunctionMap["UGAL_G_three_hop_restricted_dragonflyfull"] = &UGAL_dragonflyfull;
-    
+        four_hop_candidate_bits(src, dst, bits.data(), scratch.data());
+        count = df_bits_popcount(bits.data(), words);
+        min_four = std::min(min_four, count);
+        max_four = std::max(max_four, count);
+        sum_four += count;
+
+        sampled += 1;
+    }
 
-    gRoutingFunctionMap["UGAL_G_four_hop_some_five_hop_restricted_dragonflyfull"] = &UGAL_dragonflyfull;
+    cout << "topology quality (" << _arrangement << "):" << endl;
+    cout << "  global links between groups: " << total_links << " , group pairs without a direct link: " << unconnected_group_pairs << endl;
+    if (unconnected_group_pairs > 0){
+        cout << "  Warning! df_min paths (min, vlb, and the MIN paths of UGAL_* / PAR_*) can't be routed between those groups. Use min_djkstra or the *_perhop routing functions." << endl;
+    }
+    cout << "  global links across a half/half cut of consecutive groups: min " << min_cut << " , max " << max_cut << endl;
+    if (sampled > 0){
+        cout << "  three hop i-nodes per router pair (" << sampled << " pairs): min " << min_three << " , mean " << (double)sum_three / sampled << " , max " << max_three << " , pairs without any: " << no_three_hop << endl;
+        cout << "  four hop i-nodes per router pair (" << sampled << " pairs): min " << min_four << " , mean " << (double)sum_four / sampled << " , max " << max_four << endl;
+    }
+}
 
 
-    gRoutingFunctionMap["PAR_dragonflyfull"] = &PAR_dragonflyfull;
-    gRoutingFunctionMap["PAR_restricted_src_only_dragonflyfull"] = &PAR_dragonflyfull;
-    gRoutingFunctionMap["PAR_restricted_src_and_dst_dragonflyfull"] = &PAR_dragonflyfull;
-    gRoutingFunctionMap["PAR_four_hop_restricted_dragonflyfull"] = &PAR_dragonflyfull;
-    gRoutingFunctionMap["PAR_three_hop_restricted_dragonflyfull"] = &PAR_dragonflyfull;
-    gRoutingFunctionMap["PAR_four_hop_some_five_hop_restricted_dragonflyfull"] = &PAR_dragonflyfull;
     
     
+void DragonFlyFull :: RegisterRoutingFunctions(){
+    cout << "inside _RegisterRoutingFunctions() ..." << endl;
+
+    //one kernel instantiation per name, check g_routing_function_table
+    for (int ii = 0; ii < g_num_routing_functions; ii++){
+        gRoutingFunctionMap[string(g_routing_function_table[ii].name) + "_dragonflyfull"] = g_routing_function_table[ii].kernel;
+    }
+    
     cout << "done with _RegisterRoutingFunctions() ..." << endl;
 }
 
@@ -1232,10 +1930,11 @@ void min_djkstra_dragonflyfull( const Router *r, const Flit *f, int in_channel,
     else if (f->hop_count == 0){   //source router
         //Call path-generator function to generate the complete path from the src and
         //    dest router using djkstra table.
-        std::vector<int> pathVector;
+        DFPath pathVector;
         
         //cout << "calling select_shortest_path_djkstra() for src, dst pair: " << current_router << "," << dst_router << endl;
         int temp = select_shortest_path_djkstra(current_router, dst_router, pathVector);
+        require_shortest_path(temp, current_router, dst_router);
         
         if (flag){
             cout << "value from select_shortest_path_djkstra() returned: " << temp << endl;
@@ -1247,7 +1946,7 @@ void min_djkstra_dragonflyfull( const Router *r, const Flit *f, int in_channel,
         }
 
         //Save the whole path in the flit
-        f->path = std::move(pathVector);
+        f->path = pathVector;
         
         //now get the port to the next hop node 
         out_port = find_port_to_node(current_router, f->path[1]);
@@ -1303,57 +2002,102 @@ For routing:
 pair as required.
 */
 
+int DragonFlyFull :: _FindGroupShiftPeriod(){
+    /*
+    Returns the smallest d (a divisor of _g) such that renaming every router n 
+    to (n + d*_a) % _N, i.e. moving every group d groups ahead and keeping the 
+    router index within the group, maps g_graph onto itself: same links, 
+    same weights, same widths. Returns _g if there is no such d.
+    
+    Shifting by d is then an automorphism, so the djkstra rows of groups [d, _g) 
+    are the rows of groups [0, d) renamed.
+    */
+    int d, shift, node, mapped_src, mapped_dst;
+    bool symmetric;
+    const DFEdge *edge, *mapped_edge;
+    
+    for (d = 1; d < _g; d++){
+        if (_g % d != 0){
+            continue;
+        }
+        shift = d * _a;
+        symmetric = true;
+        
+        for (node = 0; node < _N && symmetric; node++){
+            mapped_src = (node + shift) % _N;
+            for (edge = g_graph.begin(node); edge != g_graph.end(node); edge++){
+                mapped_dst = (edge->dst + shift) % _N;
+                
+                for (mapped_edge = g_graph.begin(mapped_src); mapped_edge != g_graph.end(mapped_src); mapped_edge++){
+                    if (mapped_edge->dst == mapped_dst){
+                        break;
+                    }
+                }
+                if (mapped_edge == g_graph.end(mapped_src) || mapped_edge->weight != edge->weight || mapped_edge->width != edge->width){
+                    symmetric = false;
+                    break;
+                }
+            }
+        }
+        
+        if (symmetric){
+            return d;
+        }
+    }
+    
+    return _g;
+}
+
 void DragonFlyFull :: _discover_djkstra_paths(){
     //go through the graph
     
-    //for every node, add all it's neighbors and their weights as adjacency list.
-    
-    //adjacency_list can be local. parents (and weights, though we dont use it 
+    //parents (and weights, though we dont use it 
     //anywhere now) needs to be global so that the routing functions can access them.
     
     cout << "\ninside _discover_djkstra_paths()" << endl;
     
-    std::vector < std::vector < std::pair<int,int> > > weighted_adjacency_list(_N);
-    int dst, weight;
-    
-    for( int src = 0; src < _N; src++){
-        weighted_adjacency_list[src].resize(g_graph[src].size());
-    }    
+    //g_graph already is the weighted adjacency list djkstra needs.
     
-    for( int src = 0; src < _N; src++){
-        for( std::size_t jj = 0; jj < g_graph[src].size(); jj++){
-            dst = (int)g_graph[src][jj];
-            weight = (int)g_link_weights[src][jj];
-            //cout << "(src,dst,weight) : " << src << ", " << dst << ", " << weight << endl;
-            weighted_adjacency_list[src][jj] = std::make_pair(dst, weight);
-        }
+    //if shifting the groups by some d maps the network onto itself, 
+    //djkstra only needs to run from the routers of groups [0, d).
+    int period = _g;
+    if (_djkstra_group_symmetry == 1){
+        period = _FindGroupShiftPeriod();
     }
-    
-    //    cout << "weighted_adjacency_list generated. Test printing:" << endl;
-    //    for( int src = 0; src < _N; src ++){
-    //        cout << src << " : ";
-    //        for( int jj = 0; jj < weighted_adjacency_list[src].size(); jj++){
-    //            cout << "(" << weighted_adjacency_list[src][jj].first << ", " << weighted_adjacency_list[src][jj].second << " ) ,";
-    //        }
-    //        cout << endl;
-    //    
-    //    }
-    
-    //allocate arrays
-    g_distance.resize(_N, std::vector< int >(_N,INF));
-    g_parents.resize(_N, std::vector< std::vector<int> >(_N));
-    cout << "g_distance and g_parents allocated." << endl;
+    g_djkstra_shift = period * _a;
+    g_djkstra_rows = period * _a;
+    cout << "group shift period: " << period << ", djkstra rows computed: " << g_djkstra_rows << " of " << _N << endl;
+
+#ifdef DJKSTRA_VERIFY_BUCKET_QUEUE
+    if (!verify_djkstra_bucket_queue(_N, g_graph)){
+        cout << "Error! bucket queue djkstra does not match the heap djkstra. Exiting." << endl;
+        exit(-1);
+    }
+#endif
 
     //now call djkstra
-    all_pair_djkstra(_N, weighted_adjacency_list, g_distance, g_parents);
-    cout << "all_pair_djkstra() returned." << endl;
+    all_pair_djkstra(_N, g_graph, g_djkstra_table, _djkstra_threads, g_djkstra_rows);
+    cout << "all_pair_djkstra() returned. " << g_djkstra_table.parents.size() << " parents stored." << endl;
     
+    if (_djkstra_path_selection == "pool"){
+        //enumerate the paths once, so the routing functions only pick one
+        g_djkstra_sample_paths = false;
+        g_djkstra_path_pool.build(g_djkstra_table, (std::size_t)_djkstra_path_pool_mb * 1024 * 1024);
+    }
+    else if (_djkstra_path_selection == "sample"){
+        g_djkstra_sample_paths = true;
+    }
+    else{
+        cout << "Error! Unknown djkstra_path_selection: " << _djkstra_path_selection << ". Exiting." << endl;
+        exit(-1);
+    }
 }
 
-int select_shortest_path_djkstra(int src_router, int dst_router, std::vector<int> & pathVector){
+int select_shortest_path_djkstra(int src_router, int dst_router, DFPath & pathVector){
     /*
-    For a particular src and dst router pair, generate all the djkstra minimal paths.
-    If there are more than one, randomly select one. 
+    For a particular src and dst router pair, get all the djkstra minimal paths 
+    from the path pool. If there are more than one, randomly select one. 
+    With g_djkstra_sample_paths, sample one uniformly by walking the parents instead.
     Copy the selected path in pathVector.
     Return 1 if path found, -1 if not. 
     */
@@ -1374,23 +2118,81 @@ int select_shortest_path_djkstra(int src_router, int dst_router, std::vector<int
     int selected_path_id;
     int path_count;
     
-    std::vector< std::vector<int> > final_paths;
+    //rows past g_djkstra_rows are not stored. Look up the shifted pair and 
+    //shift the paths back.
+    int shift = (src_router / g_djkstra_shift) * g_djkstra_shift;
+    
+    if (g_djkstra_sample_paths){
+        uint16_t sampled_path[DF_DJKSTRA_INF_DISTANCE + 1];
+        int length = g_djkstra_table.sample_path(src_router - shift, (dst_router - shift + g_N) % g_N, RandomInt, sampled_path);
+        
+        if (length == 0){
+            cout << "no paths found between router pairs " << src_router << " and " << dst_router << endl; 
+            return -1;
+        }
+        pathVector.clear();
+        for (int ii = 0; ii < length; ii++){
+            pathVector.push_back((sampled_path[ii] + shift) % g_N);
+        }
+        return 1;
+    }
     
-    generate_path(src_router, dst_router, g_parents, final_paths);
+    DFPathPoolView paths = g_djkstra_path_pool.lookup(src_router - shift, (dst_router - shift + g_N) % g_N);
     
-    path_count = final_paths.size();
+    path_count = paths.count;
     
     if (path_count == 0){
         cout << "no paths found between router pairs " << src_router << " and " << dst_router << endl; 
         return -1;
     }else{
         selected_path_id = RandomInt(path_count-1); //RandomInt gets a number in the range[0,max], inclusive.
-        pathVector = std::move(final_paths[selected_path_id]); 
+        const uint16_t *selected_path = paths.path(selected_path_id);
+        int length = paths.length(selected_path_id);
+        pathVector.clear();
+        for (int ii = 0; ii < length; ii++){
+            pathVector.push_back((selected_path[ii] + shift) % g_N);
+        }
         return 1;
     }
     
 }
 
+int local_port_to_node(int current_router, int next_router){
+    /*
+    Local links are one port wide, and the local ports come right after the _p 
+    PE ports, ordered by the local index of the neighbor with the router itself
+    skipped. So no lookup needed.
+    */
+    int current_index = current_router % g_a;
+    int next_index = next_router % g_a;
+    return g_p + next_index - (next_index > current_index);
+}
+
+void port_range_to_node(int current_router, int next_router, int &first_port, int &last_port){
+    /*
+    Closed range of output ports from current_router to next_router.
+    Replaces the old g_port_map lookup, which hashed a pair on every hop.
+    */
+    if ((current_router / g_a) == (next_router / g_a)){
+        first_port = local_port_to_node(current_router, next_router);
+        last_port = first_port;
+        return;
+    }
+
+    //global neighbor, g_global_port_index gives its edge in the row
+    int slot = g_global_port_index.slot(current_router, next_router);
+    const DFEdge *edge = g_graph.begin(current_router) + (g_a - 1) + slot;
+
+    if ((slot != DF_NO_GLOBAL_SLOT) && (edge->dst == next_router)){
+        first_port = edge->first_port;
+        last_port = edge->first_port + edge->width - 1;
+        return;
+    }
+
+    cout << "Error! No port from router " << current_router << " to router " << next_router << " . Exiting." << endl;
+    exit(-1);
+}
+
 int find_port_to_node(int current_router, int next_router){
     /*
     As the name suggests. Get the port and return.
@@ -1403,15 +2205,20 @@ int find_port_to_node(int current_router, int next_router){
     Return -1 if no port found.
     */
     
-    //we already populated g_port_map for this purpose
+    //we already populated the dense port map for this purpose
     
-    auto port_range = g_port_map[std::make_pair(current_router, next_router)];
+    int first_port, last_port;
+    port_range_to_node(current_router, next_router, first_port, last_port);
     
-    int selected = RandomInt(port_range.second - port_range.first); 
-                    //range returned by g_port_map is a closed range. For example, for port 5 it'll return (5,5) pair
+    if (first_port == last_port){
+        return first_port;  //single channel, every local link and almost every global link.
+    }
+
+    int selected = RandomInt(last_port - first_port); 
+                    //port_range_to_node() gives a closed range. For example, for port 5 it'll return (5,5) pair
                     //RandomInt also returns an int in the range [0, x]. So subtracting 1 is not needed in this case.
     
-    return (port_range.first + selected);
+    return (first_port + selected);
             //There was an error here. Instead of first, I put second and 
             //added "selected" to it. However, this didnt throw any error
             //as none of the dragonfly links we used had more than 1 channel.
@@ -1513,11 +2320,12 @@ void min_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     }
     else if (f->hop_count == 0){   //source router
     
-        std::vector<int> pathVector;
+        DFPath pathVector;
         
         //cout << "calling select_shortest_path() for src, dst pair: " << current_router << "," << dst_router << endl;
         
         int temp = select_shortest_path(current_router, dst_router, pathVector);
+        require_shortest_path(temp, current_router, dst_router);
         
         if (flag){
             cout << "value from select_shortest_path() returned: " << temp << endl;
@@ -1529,7 +2337,7 @@ void min_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
         }
 
         //Save the whole path in the flit
-        f->path = std::move(pathVector);
+        f->path = pathVector;
         
         //now get the port to the next hop node 
         out_port = find_port_to_node(current_router, f->path[1]);
@@ -1579,7 +2387,7 @@ void min_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
         out_port = find_port_to_node(current_router, f->path[ f->hop_count + 1]);
         
         //assign vc 
-        if (g_vc_allocation_mode == "incremental"){
+        if (g_vc_allocation_mode == DF_VC_INCREMENTAL){
             out_vc = f->hop_count;
         }
         else{
@@ -1599,7 +2407,18 @@ void min_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
 }
 
 
-int select_shortest_path(int src_router, int dst_router, std::vector<int> & pathVector){
+void require_shortest_path(int result, int src_router, int dst_router){
+    /*
+    The path selectors return -1 and leave the path empty if there is no path.
+    DFPath has no bounds check, so stop here rather than route on garbage.
+    */
+    if (result != 1){
+        cout << "Error! No min path found between routers " << src_router << " and " << dst_router << " . Exiting." << endl;
+        exit(-1);
+    }
+}
+
+int select_shortest_path(int src_router, int dst_router, DFPath & pathVector){
     /*
     Get the src and dest group.
     Get destination group.
@@ -1626,13 +2445,16 @@ int select_shortest_path(int src_router, int dst_router, std::vector<int> & path
     
     //case 1: src and dst are in different groups
     else{
-        if (g_inter_group_links[src_group][dst_group].size() == 0){
-            cout << "no paths found between router pairs " << src_router << " and " << dst_router << endl; 
+        int first_link = g_inter_group_link_offsets[src_group * g_g + dst_group];
+        int link_count = g_inter_group_link_offsets[src_group * g_g + dst_group + 1] - first_link;
+
+        if (link_count == 0){
+            cout << "no paths found between router pairs " << src_router << " and " << dst_router << endl;
             return -1;
         }
-        
-        link_to_select = RandomInt(g_inter_group_links[src_group][dst_group].size() - 1); 
-        selected_global_link = g_inter_group_links[src_group][dst_group][link_to_select];
+
+        link_to_select = RandomInt(link_count - 1);
+        selected_global_link = g_inter_group_links[first_link + link_to_select];
         
         if ((src_router == selected_global_link.first) && (dst_router == selected_global_link.second)){
             pathVector = {src_router, dst_router};
@@ -1651,7 +2473,8 @@ int select_shortest_path(int src_router, int dst_router, std::vector<int> & path
 
 }
 
-void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFVcAllocationMode VC_MODE>
+void vlb_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
     /*
     Regular VLB routing function.
     For a Src and Dst, (randomly) select an Intermediate node.
@@ -1741,12 +2564,12 @@ void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     else if (f->hop_count == 0){   //source router
         //actual VLB routing needs to happen here.
         
-        std::vector<int> pathVector;
+        DFPath pathVector;
         
         //cout << "calling select_vlb_path() for src, dst pair: " << current_router << "," << dst_router << endl;
         
         //int temp = select_vlb_path_regular(f, current_router, dst_router, pathVector);
-        int temp = select_vlb_path(f, current_router, dst_router, pathVector);
+        int temp = select_vlb_path<SELECT_IMDT, VLB_SHORTEST_PATH>(f, current_router, dst_router, pathVector);
                 //this function supports both regular and restricted vlb modes.
 
         if (flag){
@@ -1760,7 +2583,7 @@ void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
         }
 
         //Save the whole path in the flit
-        f->path = std::move(pathVector);
+        f->path = pathVector;
         
         //now get the port to the next hop node 
         out_port = find_port_to_node(current_router, f->path[1]);
@@ -1790,7 +2613,7 @@ void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
         out_port = find_port_to_node(current_router, f->path[ f->hop_count + 1]);
         
         //assign vc 
-        if (g_vc_allocation_mode == "incremental"){
+        if (VC_MODE == DF_VC_INCREMENTAL){
             out_vc = f->hop_count;
         }
         else{
@@ -1809,6 +2632,21 @@ void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     
 }
 
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH>
+void vlb_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+    /*
+    What gets registered for every vlb_* routing function.
+    The i-node selector and the path flavor are fixed by the routing function name.
+    vc_allocation_mode comes from the config file, so pick the matching 
+    specialization here. Everything below this point is fixed at compile time.
+    */
+    if (g_vc_allocation_mode == DF_VC_INCREMENTAL){
+        vlb_route<SELECT_IMDT, VLB_SHORTEST_PATH, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+    }else{
+        vlb_route<SELECT_IMDT, VLB_SHORTEST_PATH, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+    }
+}
+
 
 /*
     Update (7 sept 2018): 
@@ -1833,7 +2671,7 @@ void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
         
     */
         
-int select_vlb_path_old(int src_router, int dst_router, std::vector<int> & pathVector){
+int select_vlb_path_old(int src_router, int dst_router, DFPath & pathVector){
     /*
     First check if the src_router and dst_router are in the same group. If yes, then route minimally.
     
@@ -1883,13 +2721,13 @@ int select_vlb_path_old(int src_router, int dst_router, std::vector<int> & pathV
             //This way, the group with more global_link to will have more selection probability,
                 //which seems logical.
             
-        std::vector<int> first_half_pathVector;
+        DFPath first_half_pathVector;
         
         //cout << "global neighbors of " << src_router << " : ";
-        for(ii = g_a-1; ii < g_graph[src_router].size(); ii++){ //loop starts from (g_a-1) to avoid local neighbors
-            //cout << g_graph[src_router][ii] << " " << (int)g_graph[src_router][ii]/g_a << endl;
-            for (jj=0; jj < g_link_widths[src_router][ii]; jj++){
-                gateway_router_list.push_back( (int)g_graph[src_router][ii] );        
+        for(const DFEdge *edge = g_graph.begin(src_router) + (g_a-1); edge != g_graph.end(src_router); edge++){ //starts from (g_a-1) to avoid local neighbors
+            //cout << edge->dst << " " << edge->dst/g_a << endl;
+            for (jj=0; jj < edge->width; jj++){
+                gateway_router_list.push_back( edge->dst );
             }
         }
         
@@ -1926,11 +2764,11 @@ int select_vlb_path_old(int src_router, int dst_router, std::vector<int> & pathV
         //For this, unmodified min-routing is being used. 
         //So we can just call the select_shortest_path() function
         
-        std::vector<int> second_half_pathVector;
+        DFPath second_half_pathVector;
         
         //cout << "calling select_shortest_path() for src, dst pair: " << current_router << "," << dst_router << endl;
         
-        select_shortest_path(imdt_router, dst_router, second_half_pathVector);
+        require_shortest_path(select_shortest_path(imdt_router, dst_router, second_half_pathVector), imdt_router, dst_router);
         
         if (flag){
                cout << "second half of the path: ";
@@ -1941,9 +2779,7 @@ int select_vlb_path_old(int src_router, int dst_router, std::vector<int> & pathV
         }
 
         //join the two vectors
-        pathVector.reserve(first_half_pathVector.size() + second_half_pathVector.size());
-        pathVector.insert(pathVector.end(), first_half_pathVector.begin(), first_half_pathVector.end());
-        pathVector.insert(pathVector.end(), second_half_pathVector.begin() + 1, second_half_pathVector.end());
+        pathVector.join(first_half_pathVector, second_half_pathVector);
         
         //        cout << "joined path: ";
         //        for (ii = 0; ii < pathVector.size(); ii++){
@@ -1957,7 +2793,7 @@ int select_vlb_path_old(int src_router, int dst_router, std::vector<int> & pathV
 }
 
 
-int select_vlb_path_regular(const Flit *f, int src_router, int dst_router, std::vector<int> & pathVector){
+int select_vlb_path_regular(const Flit *f, int src_router, int dst_router, DFPath & pathVector){
     /*
         Plain vanilla VLB routing.
         
@@ -2005,21 +2841,19 @@ int select_vlb_path_regular(const Flit *f, int src_router, int dst_router, std::
     
     //case 1: src and dst are in differnet groups 
     else{
-        std::vector<int> first_half_pathVector;
-        std::vector<int> second_half_pathVector;
+        DFPath first_half_pathVector;
+        DFPath second_half_pathVector;
         
         //select intermediate node 
         //shipping it out to a separate function for easy modifications.
         imdt_router = vlb_intermediate_node_vanilla(f, src_router, dst_router);
         
-        select_shortest_path(src_router, imdt_router, first_half_pathVector);
-        select_shortest_path(imdt_router, dst_router, second_half_pathVector);
+        require_shortest_path(select_shortest_path(src_router, imdt_router, first_half_pathVector), src_router, imdt_router);
+        require_shortest_path(select_shortest_path(imdt_router, dst_router, second_half_pathVector), imdt_router, dst_router);
         
         
         //join the two vectors
-        pathVector.reserve(first_half_pathVector.size() + second_half_pathVector.size());
-        pathVector.insert(pathVector.end(), first_half_pathVector.begin(), first_half_pathVector.end());
-        pathVector.insert(pathVector.end(), second_half_pathVector.begin() + 1, second_half_pathVector.end());
+        pathVector.join(first_half_pathVector, second_half_pathVector);
         
     }
     
@@ -2035,7 +2869,8 @@ int select_vlb_path_regular(const Flit *f, int src_router, int dst_router, std::
 
 
 
-int select_vlb_path(const Flit *f, int src_router, int dst_router, std::vector<int> & pathVector){
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH>
+int select_vlb_path(const Flit *f, int src_router, int dst_router, DFPath & pathVector){
     /*
         VLB routing with regular and restricted mode support.
         
@@ -2067,9 +2902,8 @@ int select_vlb_path(const Flit *f, int src_router, int dst_router, std::vector<i
     int ii;
     bool flag = false;
 
-    std::vector<int> imdt_nodes;
-    int no_of_VLB_paths_to_consider = 1;
-    imdt_nodes.resize(no_of_VLB_paths_to_consider);   //we are only considering one vlb path 
+    int no_of_VLB_paths_to_consider = 1;   //we are only considering one vlb path 
+    int imdt_nodes[1];
     
     src_group = src_router / g_a;
     dst_group = dst_router / g_a;
@@ -2094,21 +2928,12 @@ int select_vlb_path(const Flit *f, int src_router, int dst_router, std::vector<i
     
     //case 1: src and dst are in differnet groups 
     else{
-        generate_imdt_nodes(f, src_router, dst_router, no_of_VLB_paths_to_consider, imdt_nodes, g_routing_mode, -1);
+        generate_imdt_nodes<SELECT_IMDT>(f, src_router, dst_router, no_of_VLB_paths_to_consider, imdt_nodes, -1);
                         // The last parameter is min_q_len, which is only
                         //relevant for multi-tier routing.
     
-        if ((g_routing_mode == "restricted_src_only") || (g_routing_mode == "restricted_src_and_dst") ||(g_routing_mode == "four_hop_restricted")||(g_routing_mode == "four_hop_some_five_hop_restricted")){
-            //generate djkstra paths
-            generate_vlb_path_from_given_imdt_node(src_router, dst_router, imdt_nodes[ii], pathVector, "djkstra");
-        }
-
-        else if (g_routing_mode == "vanilla"){
-            generate_vlb_path_from_given_imdt_node(src_router, dst_router, imdt_nodes[ii], pathVector, "generic"); 
-        }else{
-            cout << "Unsupported routing mode: " << g_routing_mode << " Exiting." << endl;
-            exit(-1);
-        }
+        //restricted modes use djkstra paths, vanilla uses df_min paths.
+        generate_vlb_path_from_given_imdt_node(src_router, dst_router, imdt_nodes[0], pathVector, VLB_SHORTEST_PATH);
     
     }
     
@@ -2124,46 +2949,157 @@ int select_vlb_path(const Flit *f, int src_router, int dst_router, std::vector<i
     return imdt_nodes[0];
 }
 
-int generate_vlb_path_from_given_imdt_node(int src_router, int dst_router, int imdt_router,  std::vector<int> & pathVector, string shortest_path_mode){
+int generate_vlb_path_from_given_imdt_node(int src_router, int dst_router, int imdt_router,  DFPath & pathVector, shortest_path_selector_t shortest_path){
     /*
     This funtion is handy when we are generating the intermediate nodes from an outside
     function following some specific scheme. In that case, this function just accepts that
     intermediate node and generate the complete path. No fuss.
+
+    shortest_path is either select_shortest_path (df_min paths) or 
+    select_shortest_path_djkstra, as picked in g_routing_function_table.
     */
     
     /*
     Skipping error checking. Assumption is that the outer function does all these.    
     */
 
-    if ((shortest_path_mode != "generic") && (shortest_path_mode != "djkstra")){
-        cout << "Error! Unsupported shortest_path_mode passed to generate_vlb_path_from_given_imdt_node(). Exiting." << endl;
+    if (shortest_path == NULL){
+        cout << "Error! No shortest_path function passed to generate_vlb_path_from_given_imdt_node(). Exiting." << endl;
         exit(-21);  //just a random error value. No further significance.
 
     }
 
-    std::vector<int> first_half_pathVector;
-    std::vector<int> second_half_pathVector;
+    DFPath first_half_pathVector;
+    DFPath second_half_pathVector;
     
-    if (shortest_path_mode == "generic"){    
-        select_shortest_path(src_router, imdt_router, first_half_pathVector);
-        select_shortest_path(imdt_router, dst_router, second_half_pathVector);
-    }
-    else if (shortest_path_mode == "djkstra"){
-        select_shortest_path_djkstra(src_router, imdt_router, first_half_pathVector);
-        select_shortest_path_djkstra(imdt_router, dst_router, second_half_pathVector);        
-    }
+    require_shortest_path(shortest_path(src_router, imdt_router, first_half_pathVector), src_router, imdt_router);
+    require_shortest_path(shortest_path(imdt_router, dst_router, second_half_pathVector), imdt_router, dst_router);
 
     //join the two vectors
-    pathVector.reserve(first_half_pathVector.size() + second_half_pathVector.size());
-    pathVector.insert(pathVector.end(), first_half_pathVector.begin(), first_half_pathVector.end());
-    pathVector.insert(pathVector.end(), second_half_pathVector.begin() + 1, second_half_pathVector.end());
+    pathVector.join(first_half_pathVector, second_half_pathVector);
     
     return 1; // means nothing at this point.
 }
 
 
 
-int select_vlb_path_inside_group(int src_router, int dst_router, std::vector<int> & pathVector){
+/*
+Draws distinct indices from [0, n) uniformly at random, without replacement.
+
+It is a partial Fisher-Yates shuffle over the virtual array 0..n-1: draw no i
+picks a slot in [i, n), returns what is there and moves slot i's value into it.
+Only the slots that were written are remembered (one per draw), so it is
+O(1) per draw and O(draws) space, no matter how big n is. No rejection, so
+the cost does not go up when most of the index space is taken.
+*/
+#define DF_MAX_SAMPLER_DRAWS 64
+
+class DFIndexSampler {
+    int _n;
+    int _drawn;
+    int _num_written;
+    int _written_slot[DF_MAX_SAMPLER_DRAWS];
+    int _written_value[DF_MAX_SAMPLER_DRAWS];
+
+    int _value_at(int slot) const {
+        for (int ii = 0; ii < _num_written; ii++){
+            if (_written_slot[ii] == slot){
+                return _written_value[ii];
+            }
+        }
+        return slot;    //never written, still holds its own index
+    }
+
+    void _write(int slot, int value){
+        for (int ii = 0; ii < _num_written; ii++){
+            if (_written_slot[ii] == slot){
+                _written_value[ii] = value;
+                return;
+            }
+        }
+        _written_slot[_num_written] = slot;
+        _written_value[_num_written] = value;
+        _num_written++;
+    }
+
+public:
+    DFIndexSampler(int n) : _n(n), _drawn(0), _num_written(0) {}
+
+    inline int remaining() const { return _n - _drawn; }
+
+    int draw(){
+        if (_drawn >= _n || _drawn >= DF_MAX_SAMPLER_DRAWS){
+            cout << "Error! Asked for more than " << (_n < DF_MAX_SAMPLER_DRAWS ? _n : DF_MAX_SAMPLER_DRAWS) << " distinct intermediate nodes. Exiting." << endl;
+            exit(-1);
+        }
+        int slot = _drawn + RandomInt(_n - _drawn - 1); //RandomInt gets a number in the range[0,max], inclusive.
+        int value = _value_at(slot);
+        _write(slot, _value_at(_drawn));
+        _drawn++;
+        return value;
+    }
+};
+
+int vanilla_imdt_index_to_node(int idx, int src_group, int dst_group){
+    /*
+    Maps idx in [0, no of routers outside src_group and dst_group) to that router,
+    by skipping over the two excluded groups.
+    */
+    int low = src_group < dst_group ? src_group : dst_group;
+    int high = src_group < dst_group ? dst_group : src_group;
+    int group = idx / g_a;
+    
+    if (group >= low){
+        group++;
+    }
+    if (high != low && group >= high){
+        group++;
+    }
+    return group * g_a + idx % g_a;
+}
+
+inline int vanilla_imdt_node_count(int src_group, int dst_group){
+    return (g_g - (src_group == dst_group ? 1 : 2)) * g_a;
+}
+
+int in_group_imdt_index_to_node(int idx, int src_router, int dst_router){
+    /*
+    Maps idx in [0, no of routers in the group other than src and dst) to that 
+    router, by skipping over src and dst.
+    */
+    int group_base = (src_router / g_a) * g_a;
+    int low = src_router < dst_router ? src_router : dst_router;
+    int high = src_router < dst_router ? dst_router : src_router;
+    int node = group_base + idx;
+    
+    if (node >= low){
+        node++;
+    }
+    if (high != low && node >= high){
+        node++;
+    }
+    return node;
+}
+
+inline int in_group_imdt_node_count(int src_router, int dst_router){
+    return g_a - (src_router == dst_router ? 1 : 2);
+}
+
+int in_group_vlb_candidate_count(int src_router, int dst_router){
+    /*
+    No of in-group VLB candidates UGAL considers for a same-group packet.
+    ugal_vlb_candidates, capped at the routers of the group other than src and dst,
+    so a small a with a large ugal_vlb_candidates still routes.
+    */
+    int count = std::min(g_ugal_vlb_candidates, in_group_imdt_node_count(src_router, dst_router));
+    if (count < 1){
+        cout << "Error: not enough in-group nodes to choose from (a = " << g_a << "). Exiting." << endl;
+        exit(-9); //-9 is just an error flag. no other meaning.
+    }
+    return count;
+}
+
+int select_vlb_path_inside_group(int src_router, int dst_router, DFPath & pathVector){
     /*  Both src and dst are within the same group. 
         So generate a vlb path inside the group.
         Basically, randomly pick an intermediate node in the group.
@@ -2181,11 +3117,9 @@ int select_vlb_path_inside_group(int src_router, int dst_router, std::vector<int
         return -1; //error
     }
     
-    int imdt_router = src_group * g_a + RandomInt(g_a - 1); //RandomInt gets a number in the range[0,max], inclusive.
-    
-    while ((imdt_router == src_router) || (imdt_router == dst_router)){
-        imdt_router = src_group * g_a + RandomInt(g_a - 1);
-    } 
+    //one draw over the routers of the group other than src and dst
+    int idx = RandomInt(in_group_imdt_node_count(src_router, dst_router) - 1); //RandomInt gets a number in the range[0,max], inclusive.
+    int imdt_router = in_group_imdt_index_to_node(idx, src_router, dst_router);
     
     pathVector = {src_router, imdt_router, dst_router};
         
@@ -2196,6 +3130,7 @@ int select_vlb_path_inside_group(int src_router, int dst_router, std::vector<int
 int vlb_intermediate_node_vanilla(const Flit *f, int src_router, int dst_router){
     /*
     Just select a node not part of either source group or destination group.
+    One draw over the allowed routers, mapped around the two excluded groups.
         
     The flit is passed for debugging.
     */
@@ -2216,21 +3151,13 @@ int vlb_intermediate_node_vanilla(const Flit *f, int src_router, int dst_router)
         cout << "dst: " << dst_router << " , dst_group: " << dst_group << endl;
     }
 
-    imdt_node = RandomInt(g_N - 1); //RandomInt gets a number in the range[0,max], inclusive.
+    imdt_node = vanilla_imdt_index_to_node(RandomInt(vanilla_imdt_node_count(src_group, dst_group) - 1), src_group, dst_group); 
+                //RandomInt gets a number in the range[0,max], inclusive.
     imdt_group = imdt_node / g_a;
 
     if(flag){
         cout << "imdt_node: " << imdt_node << " , imdt_group: " << imdt_group << endl;
     }
-        
-    while ((imdt_group == src_group) || (imdt_group == dst_group)){
-        imdt_node = RandomInt(g_N - 1); //RandomInt gets a number in the range[0,max], inclusive. 
-        imdt_group = imdt_node / g_a;
-
-        if(flag){
-            cout << "imdt_node: " << imdt_node << " , imdt_group: " << imdt_group << endl;
-        }
-    }
      
     if (flag){
         cout << "returning imdt_node: " << imdt_node << endl;
@@ -2304,94 +3231,184 @@ int vlb_imdt_node_for_five_hop_paths_src_only(const Flit *f, int src_router, int
             cout << "idx: " << idx << "  , imdt_node: " << imdt_node << " , imdt_group: " << imdt_group << endl;
         }
     }
-        
-    return imdt_node;
+        
+    return imdt_node;
+}
+
+
+/*
+Candidate i-node lists of the restricted modes, built from the neighbor bitsets
+with a few whole-set operations. The lists come out sorted.
+*/
+void five_hop_candidate_bits(int src_router, int dst_router, uint64_t *out, uint64_t *scratch){
+    /*
+    Union of src's and dst's two-hop neighbors, leaving out the ones in the 
+    other end's group.
+    */
+    int words = two_hop_neighbors_bits.words();
+    int src_group = src_router / g_a;
+    int dst_group = dst_router / g_a;
+
+    std::copy(two_hop_neighbors_bits.row(src_router), two_hop_neighbors_bits.row(src_router) + words, out);
+    df_bits_clear_range(out, dst_group * g_a, (dst_group + 1) * g_a);
+
+    std::copy(two_hop_neighbors_bits.row(dst_router), two_hop_neighbors_bits.row(dst_router) + words, scratch);
+    df_bits_clear_range(scratch, src_group * g_a, (src_group + 1) * g_a);
+
+    df_bits_or(out, out, scratch, words);
+}
+
+void four_hop_candidate_bits(int src_router, int dst_router, uint64_t *out, uint64_t *scratch){
+    /*
+        1. Get the global links connected to src. Get their other ends.
+        2. get the global links connected to dst. Get their other ends.
+        3. Lookup to see if there is any node that has global links to both src and dst groups.
+    */
+    int words = one_hop_neighbors_bits.words();
+    int src_group = src_router / g_a;
+    int dst_group = dst_router / g_a;
+
+    //1. Get the global links connected to src. Get their other ends.
+    std::copy(one_hop_neighbors_bits.row(src_router), one_hop_neighbors_bits.row(src_router) + words, out);
+    df_bits_clear_range(out, dst_group * g_a, (dst_group + 1) * g_a);
+
+    //2. Get the global links connected to dst. Get their other ends.
+    std::copy(one_hop_neighbors_bits.row(dst_router), one_hop_neighbors_bits.row(dst_router) + words, scratch);
+    df_bits_clear_range(scratch, src_group * g_a, (src_group + 1) * g_a);
+    df_bits_or(out, out, scratch, words);
+
+    //3. Lookup for common links for src_group, dst_group combo.
+    DFListView<int> candidates = g_group_pair_vs_common_nodes[src_group * g_g + dst_group];
+    for (std::size_t ii = 0; ii < candidates.size(); ii++){
+        df_bits_set(out, candidates[ii]);
+    }
 }
 
+void three_hop_candidate_bits(int src_router, int dst_router, uint64_t *out, uint64_t *scratch){
+    /*
+        1. src's 2-hop neighbors that are directly connected to dst, and not in dst's group.
+        2. dst's 2-hop neighbors that are directly connected to src, and not in src's group.
+    */
+    int words = two_hop_neighbors_bits.words();
+    int src_group = src_router / g_a;
+    int dst_group = dst_router / g_a;
 
-int vlb_imdt_node_for_five_hop_paths_src_and_dst(const Flit *f, int src_router, int dst_router){
+    //1.
+    df_bits_and(out, two_hop_neighbors_bits.row(src_router), one_hop_neighbors_bits.row(dst_router), words);
+    df_bits_clear_range(out, dst_group * g_a, (dst_group + 1) * g_a);
 
-    bool flag = false;
-    if (f->id == FLIT_TO_TRACK){
-        flag = true;
+    //2.
+    df_bits_and(scratch, two_hop_neighbors_bits.row(dst_router), one_hop_neighbors_bits.row(src_router), words);
+    df_bits_clear_range(scratch, src_group * g_a, (src_group + 1) * g_a);
+
+    df_bits_or(out, out, scratch, words);
+}
+
+DFCandidateView four_hop_candidates(int src_router, int dst_router){
+    if (g_four_hop_candidates.built(src_router, dst_router)){
+        return g_four_hop_candidates.get(src_router, dst_router);
     }
+    int words = one_hop_neighbors_bits.words();
+    std::vector<uint64_t> bits(words), scratch(words);
+    std::vector<int> i_nodes;
 
-    if (flag){
-        cout << "inside vlb_imdt_node_for_five_hop_paths_src_and_dst() for flit: " << f->id << endl;
+    four_hop_candidate_bits(src_router, dst_router, bits.data(), scratch.data());
+    df_bits_to_vector(bits.data(), words, i_nodes);
+    return g_four_hop_candidates.insert(src_router, dst_router, i_nodes);
+}
+
+DFCandidateView five_hop_candidates(int src_router, int dst_router){
+    if (g_five_hop_candidates.built(src_router, dst_router)){
+        return g_five_hop_candidates.get(src_router, dst_router);
     }
+    int words = two_hop_neighbors_bits.words();
+    std::vector<uint64_t> bits(words), scratch(words);
+    std::vector<int> imdt_node_pool;
 
-    std::size_t ii;
+    five_hop_candidate_bits(src_router, dst_router, bits.data(), scratch.data());
+    df_bits_to_vector(bits.data(), words, imdt_node_pool);
+    return g_five_hop_candidates.insert(src_router, dst_router, imdt_node_pool);
+}
 
-    int temp_node;
-    int src_group, dst_group;
-    
-    std::unordered_set<int> imdt_node_set;
-    
-    src_group = src_router / g_a;
-    dst_group = dst_router / g_a;
+DFCandidateView unique_five_hop_candidates(int src_router, int dst_router){
+    /*
+    The five hop i-nodes (src's and dst's two-hop neighbors) that are not 
+    four hop i-nodes as well.
+    */
+    if (g_unique_five_hop_candidates.built(src_router, dst_router)){
+        return g_unique_five_hop_candidates.get(src_router, dst_router);
+    }
+    int words = two_hop_neighbors_bits.words();
+    std::vector<uint64_t> five_hop_bits(words), four_hop_bits(words), scratch(words);
+    std::vector<int> unique_five_hop_nodes;
 
+    five_hop_candidate_bits(src_router, dst_router, five_hop_bits.data(), scratch.data());
+    four_hop_candidate_bits(src_router, dst_router, four_hop_bits.data(), scratch.data());
+    df_bits_andnot(five_hop_bits.data(), five_hop_bits.data(), four_hop_bits.data(), words);
 
-    std::vector<int> imdt_node_pool;
+    df_bits_to_vector(five_hop_bits.data(), words, unique_five_hop_nodes);
+    return g_unique_five_hop_candidates.insert(src_router, dst_router, unique_five_hop_nodes);
+}
 
-    
-    if(flag){
-        cout << "src: " << src_router << endl;
-        cout << "src_group: " << src_group << endl;
+DFCandidateView three_hop_candidates(int src_router, int dst_router){
+    /*
+    three_hop_candidate_bits(). If there is none, the pair gets the four hop 
+    candidates instead.
+    */
+    if (g_three_hop_candidates.built(src_router, dst_router)){
+        return g_three_hop_candidates.get(src_router, dst_router);
+    }
+    int words = two_hop_neighbors_bits.words();
+    std::vector<uint64_t> bits(words), scratch(words);
+    std::vector<int> i_nodes;
 
-        cout << "src two hop neighbors: ";
-        for(ii = 0; ii < two_hop_neighbors_vector[src_router].size(); ii++ ){
-            cout << two_hop_neighbors_vector[src_router][ii] << "    ";
-        }
-        cout << endl;
+    three_hop_candidate_bits(src_router, dst_router, bits.data(), scratch.data());
 
-        cout << "dst: " << dst_router << endl;
-        cout << "dst_group: " << dst_group << endl;
-        cout << "dst two hop neighbors: ";
-        for(ii = 0; ii < two_hop_neighbors_vector[dst_router].size(); ii++ ){
-            cout << two_hop_neighbors_vector[dst_router][ii] << "    ";
-        }
-        cout << endl;
+    if (df_bits_popcount(bits.data(), words) == 0){
+        four_hop_candidate_bits(src_router, dst_router, bits.data(), scratch.data());
     }
 
-    for (ii = 0; ii< two_hop_neighbors_vector[src_router].size(); ii++){
-        temp_node = two_hop_neighbors_vector[src_router][ii]; 
-        if ( (temp_node < (dst_group * g_a)) || (temp_node >= ( (dst_group + 1) * g_a) ) ){
-                imdt_node_set.insert(temp_node);
-        }
+    df_bits_to_vector(bits.data(), words, i_nodes);
+    return g_three_hop_candidates.insert(src_router, dst_router, i_nodes);
+}
+
+void print_candidates(const DFCandidateView &candidates){
+    for (int ii = 0; ii < candidates.count; ii++){
+        cout << candidates.nodes[ii] << " ";
     }
+    cout << endl;
+}
 
+int vlb_imdt_node_for_five_hop_paths_src_and_dst(const Flit *f, int src_router, int dst_router){
 
-    for (ii = 0; ii< two_hop_neighbors_vector[dst_router].size(); ii++){
-        temp_node = two_hop_neighbors_vector[dst_router][ii]; 
-        if ( (temp_node < (src_group * g_a)) || (temp_node >= ( (src_group + 1) * g_a) ) ){
-                imdt_node_set.insert(temp_node);
-        }
+    bool flag = false;
+    if (f->id == FLIT_TO_TRACK){
+        flag = true;
     }
 
-    for(auto it = imdt_node_set.begin(); it != imdt_node_set.end(); it++){
-        imdt_node_pool.push_back(*it);
+    if (flag){
+        cout << "inside vlb_imdt_node_for_five_hop_paths_src_and_dst() for flit: " << f->id << endl;
     }
 
-    std::sort(imdt_node_pool.begin(), imdt_node_pool.end());
+    DFCandidateView imdt_node_pool = five_hop_candidates(src_router, dst_router);
 
     if(flag){
+        cout << "src: " << src_router << " , src_group: " << src_router / g_a << endl;
+        cout << "dst: " << dst_router << " , dst_group: " << dst_router / g_a << endl;
         cout << "selected imdt nodes pool: ";
-        for(ii = 0; ii < imdt_node_pool.size(); ii++ ){
-            cout << imdt_node_pool[ii] << "    ";
-        }
-        cout << endl;
+        print_candidates(imdt_node_pool);
     }
     //return a node randomly from selected intermediate pool 
 
-    int temp = RandomInt(imdt_node_pool.size()-1); 
+    int temp = RandomInt(imdt_node_pool.count-1); 
                 //RandomInt(max) selects an int from range(0,max]; max inclusive.
     
     if (flag){
         cout << "rand_int: " << temp << endl;
-        cout << "selected node: " << imdt_node_pool[temp] << endl;
+        cout << "selected node: " << imdt_node_pool.nodes[temp] << endl;
     }
 
-    return imdt_node_pool[temp];
+    return imdt_node_pool.nodes[temp];
 
 }
 
@@ -2407,157 +3424,60 @@ int vlb_imdt_node_for_four_hop_and_some_five_hop_paths(const Flit *f, int src_ro
     - Shuffle the extra-ones set (vector). Take the specified percentage from it.
     - Return the combined set of four-hop paths and these recently-picked ones.
 
-    Now lets see how this logic can be implemented in Cpp.  
-
+    The four-hop set and the extra ones are cached per pair. Nothing is shuffled
+    or copied per packet. The eligible list is four_hop_nodes followed by cut_off
+    random extra ones. One draw over count + cut_off decides between the two, and
+    a draw that lands on the extra ones picks any of them, which is what picking
+    one of cut_off shuffled extra ones comes to.
     */
 
 
     bool flag = false;
     if (flag){
         cout << "inside vlb_imdt_node_for_four_hop_and_some_five_hop_paths()" << endl;
+        cout << "src, dst, src_group, dst_group:" << src_router << "," << dst_router << "," << src_router / g_a << "," << dst_router / g_a << endl;
     }
 
-    //first get the four-hop nodes. We already have a function for that.
-    //Take help from there.    
-    std::unordered_set<int> four_hop_nodes;
-    std::unordered_set<int> five_hop_nodes;
-    std::vector<int> unique_five_hop_nodes;
-    std::vector<int> eligible_inodes;
- 
-    int ii;
-    int src_group, dst_group;
-    int temp_node;
     int cut_off;
     int rdm_idx;
-    
-    src_group = src_router / g_a;
-    dst_group = dst_router / g_a;
-
-    if (flag){
-        cout << "src, dst, src_group, dst_group:" << src_router << "," << dst_router << "," << src_group << "," << dst_group << endl;
-    }
-
-    //1. Get the global links connected to src. Get their other ends.
-    for (ii = g_a-1; ii < g_graph[src_router].size(); ii++){
-        if (g_graph[src_router][ii] / g_a != dst_group){
-            four_hop_nodes.insert(g_graph[src_router][ii]);
-        }
-    }
-
-    //2. Get the global links connected to dst. Get their other ends.
-    for (ii = g_a-1; ii < g_graph[dst_router].size(); ii++){
-        if (g_graph[dst_router][ii] / g_a != src_group){
-            four_hop_nodes.insert(g_graph[dst_router][ii]);
-        }
-    }
-
-    //3. Lookup for common links for src_group, dst_group combo.
-    //std::unordered_map < std::pair<int, int>, std::vector<int>, pair_hash > g_group_pair_vs_common_nodes;
-
-    if ( g_group_pair_vs_common_nodes.find( std::make_pair(src_group, dst_group)) != g_group_pair_vs_common_nodes.end()  ){
-            std::vector<int> candidates = g_group_pair_vs_common_nodes[std::make_pair(src_group, dst_group)];
+    int selected;
 
-            for (ii = 0; ii < candidates.size(); ii++){
-                four_hop_nodes.insert(candidates[ii]);
-            }
-    }
+    DFCandidateView four_hop_nodes = four_hop_candidates(src_router, dst_router);
+    DFCandidateView extra_nodes = unique_five_hop_candidates(src_router, dst_router);
 
     if (flag){
         cout << "four hop nodes: ";
-        print_container(four_hop_nodes); 
-        cout << endl;
-    }
-
-    //Four hop nodes found. Now gather all the five hop nodes.
-    //First, src's two hop neighbors
-    for (ii = 0; ii< two_hop_neighbors_vector[src_router].size(); ii++){
-        temp_node = two_hop_neighbors_vector[src_router][ii]; 
-        if ( (temp_node < (dst_group * g_a)) || (temp_node >= ( (dst_group + 1) * g_a) ) ){
-                five_hop_nodes.insert(temp_node);
-        }
-    }
-
-    //then dest's two-hop neighbors.
-    for (ii = 0; ii< two_hop_neighbors_vector[dst_router].size(); ii++){
-        temp_node = two_hop_neighbors_vector[dst_router][ii]; 
-        if ( (temp_node < (src_group * g_a)) || (temp_node >= ( (src_group + 1) * g_a) ) ){
-                five_hop_nodes.insert(temp_node);
-        }
-    }
-
-    if (flag){
-        cout << "five hop nodes: ";
-        print_container(five_hop_nodes);   
-        cout << endl;
-    }
-
-    //Now find the five-hop inodes that are also not four-hop inodes.
-    for(auto it = five_hop_nodes.begin(); it != five_hop_nodes.end(); it++){
-        if ( four_hop_nodes.find(*it) == four_hop_nodes.end() ){
-            unique_five_hop_nodes.push_back(*it);
-        }
-    }
-
-    if (flag){
+        print_candidates(four_hop_nodes);
         cout << "Unique five hop nodes: ";
-        print_container(unique_five_hop_nodes);   
-        cout << endl;
-    }
-
-
-    //random-shuffle
-    //use the fisher-yates shuffle in traffic.
-    fisher_yates_shuffle(unique_five_hop_nodes, unique_five_hop_nodes.size());
-    if (flag){
-        cout << "Unique five hop nodes after shuffling: ";
-        print_container(unique_five_hop_nodes);   
-        cout << endl;
+        print_candidates(extra_nodes);
     }
 
     //get the cutoff point
-    cut_off = unique_five_hop_nodes.size() * five_hop_percentage / 100 + 1;
+    cut_off = extra_nodes.count * five_hop_percentage / 100 + 1;
+    if (cut_off > extra_nodes.count){
+        cut_off = extra_nodes.count; //the +1 above runs past the end when there are no extra ones
+    }
     if (flag){
         cout << "cut_off: " << cut_off << endl;
     }
 
+    //randomly pick one from four_hop_nodes + the first cut_off extra ones, and return
+    rdm_idx = RandomInt(four_hop_nodes.count + cut_off - 1); //RandomInt includes the limit
 
-    //generate the eligible inode list
-    for (auto it = four_hop_nodes.begin(); it!= four_hop_nodes.end(); it++){
-        eligible_inodes.push_back(*it);
-    }
-
-    for (ii = 0; ii < cut_off; ii ++){
-        eligible_inodes.push_back(unique_five_hop_nodes[ii]);
-    }
-    if (flag){
-        cout << "eligible inodes: ";
-        print_container(eligible_inodes);   
-        cout << endl;
+    if (rdm_idx < four_hop_nodes.count){
+        selected = four_hop_nodes.nodes[rdm_idx];
+    }else{
+        selected = extra_nodes.nodes[RandomInt(extra_nodes.count - 1)];
     }
 
-
-    //randomly pick one, and return
-    rdm_idx = RandomInt(eligible_inodes.size() - 1); //RandomInt includes the limit
-
     if (flag){
-        cout << "random idx:" << rdm_idx << " , selected inode: " << eligible_inodes[rdm_idx] << endl;
+        cout << "random idx:" << rdm_idx << " , selected inode: " << selected << endl;
     }
 
-    return eligible_inodes[rdm_idx];
+    return selected;
 }
 
 
-template <typename T>
-void fisher_yates_shuffle(T &container, int size){
-  for(int ii = size-1; ii > 0; ii--){
-      //pick a random index from 0 to ii
-      int jj = RandomInt(ii-1); //RandomInt is inclusive of ii
-                                //here, using ii-1 means a node can not be paired with itself.
-      //swap 
-      std::swap(container[ii], container[jj]);
-  }
-}
-
 
 //Updated version. Chooses the four hop vlb paths beased on global links.
 int vlb_imdt_node_for_four_hop_paths(const Flit *f, int src_router, int dst_router){
@@ -2568,62 +3488,27 @@ int vlb_imdt_node_for_four_hop_paths(const Flit *f, int src_router, int dst_rout
         3. Lookup to see if there is any node that has global links to both src and dst groups.
             If there exists one, pick that one up.
     
-    Also, cache the list of i-nodes for a (src_router, dst_router) combo.
+    The list of i-nodes for a (src_router, dst_router) combo is cached, see four_hop_candidates().
     */    
     bool flag = false;
 
-    std::unordered_set<int> i_nodes;
-    std::vector<int> i_node_vector;
-    int ii;
-    int src_group, dst_group;
     int rdm_idx;
 
-    src_group = src_router / g_a;
-    dst_group = dst_router / g_a;
-
-    //1. Get the global links connected to src. Get their other ends.
-    for (ii = g_a-1; ii < g_graph[src_router].size(); ii++){
-        if (g_graph[src_router][ii] / g_a != dst_group){
-            i_nodes.insert(g_graph[src_router][ii]);
-        }
-    }
-
-    //2. Get the global links connected to dst. Get their other ends.
-    for (ii = g_a-1; ii < g_graph[dst_router].size(); ii++){
-        if (g_graph[dst_router][ii] / g_a != src_group){
-            i_nodes.insert(g_graph[dst_router][ii]);
-        }
-    }
-
-    //3. Lookup for common links for src_group, dst_group combo.
-    //std::unordered_map < std::pair<int, int>, std::vector<int>, pair_hash > g_group_pair_vs_common_nodes;
-
-    if ( g_group_pair_vs_common_nodes.find( std::make_pair(src_group, dst_group)) != g_group_pair_vs_common_nodes.end()  ){
-            std::vector<int> candidates = g_group_pair_vs_common_nodes[std::make_pair(src_group, dst_group)];
-
-            for (ii = 0; ii < candidates.size(); ii++){
-                i_nodes.insert(candidates[ii]);
-            }
-    }
-
-    //all potential i_nodes stored in the set. Now randomly pick one.
-    i_node_vector.resize(i_nodes.size());
-
-    std::copy(i_nodes.begin(), i_nodes.end(), i_node_vector.begin());
+    DFCandidateView i_nodes = four_hop_candidates(src_router, dst_router);
 
     if (flag){
         cout << "candidate inodes for src " << src_router << " and dst " << dst_router << ":  ";
-        print_container(i_node_vector);
+        print_candidates(i_nodes);
     }   
 
     
-    rdm_idx = RandomInt(i_node_vector.size() - 1); //RandomInt includes the limit
+    rdm_idx = RandomInt(i_nodes.count - 1); //RandomInt includes the limit
 
     if (flag){
         cout << "random int: " << rdm_idx;
-        cout << " node: " << i_node_vector[rdm_idx] << endl;
+        cout << " node: " << i_nodes.nodes[rdm_idx] << endl;
     }
-    return i_node_vector[rdm_idx];
+    return i_nodes.nodes[rdm_idx];
     
 }
 
@@ -2632,110 +3517,27 @@ int vlb_imdt_node_for_three_hop_paths(const Flit *f, int src_router, int dst_rou
     // Logic:
     //     1. Get the 2-hop neighbors of src. See any of them are directly connected to dst. If yes, and not in dst's group,  add as a candidate.
     //     2. Get the 2-hop neighbors of dst. See any of them are directly connected to src. If yes, and not in src's group, add as a candidate.
+    // If there is no such node, fall back to the four hop i-nodes.
+    // Both are folded into the cached list, see three_hop_candidates().
 
     bool flag = false;
 
-    std::unordered_set<int> src_neighbors;
-    std::unordered_set<int> dst_neighbors;
-    std::unordered_set<int> i_node_set;
-    std::vector<int> i_node_vector;
-    
-    //std::vector<int> unique_five_hop_nodes;
- 
-    int ii;
-    int src_group, dst_group;
-    int temp_node;
     int rdm_idx;
-    int ret_val;
-
-    src_group = src_router / g_a;
-    dst_group = dst_router / g_a;
-
-
-    if(flag){
-        cout << "src: " << src_router << endl;
-        cout << "src_group: " << src_group << endl;
-        cout << "dst: " << dst_router << endl;
-        cout << "dst_group: " << dst_group << endl;
-    
-    }
-
-    //1. Get the global nodes connected to src
-    for (ii = g_a-1; ii < g_graph[src_router].size(); ii++){
-        src_neighbors.insert(g_graph[src_router][ii]);
-    }
-    if (flag){
-        cout << "src neighbors:";
-        print_container(src_neighbors);
-    }
-
-    //2. Get the global nodes connected to dst
-    for (ii = g_a-1; ii < g_graph[dst_router].size(); ii++){
-        dst_neighbors.insert(g_graph[dst_router][ii]);
-    }
-    if (flag){
-        cout << "src neighbors:";
-        print_container(dst_neighbors);
-    }
-    
-
-
-    //3. Get the 2hop neighbors of src. If they are not in dst's group,
-    //check to see if they are directly connected to dst. If yes, add
-    //as a candidate.
-    for(ii = 0; ii < two_hop_neighbors_vector[src_router].size(); ii++){
-        temp_node =  two_hop_neighbors_vector[src_router][ii];
-        if ( (temp_node / g_a) != dst_group ){
-            if (dst_neighbors.find(temp_node) != dst_neighbors.end()){
-                i_node_set.insert(temp_node);
-            }
-        }
-    }
-
-    //4. Get the 2hop neighbors of dst. If they are not in src's group,
-    //check to see if they are directly connected to src. If yes, add
-    //as a candidate.
-    for(ii = 0; ii < two_hop_neighbors_vector[dst_router].size(); ii++){
-        temp_node =  two_hop_neighbors_vector[dst_router][ii];
-        if ( (temp_node / g_a) != src_group ){
-            if (src_neighbors.find(temp_node) != src_neighbors.end()){
-                i_node_set.insert(temp_node);
-            }
-        }
-    }
-
-    if (flag){
-        cout << "candidate inode set for src " << src_router << " and dst " << dst_router << ":  ";
-        print_container(i_node_set);
-    }
 
-    //all potential i_nodes stored in the set. Now randomly pick one.
-    i_node_vector.resize(i_node_set.size());
-
-    std::copy(i_node_set.begin(), i_node_set.end(), i_node_vector.begin());
+    DFCandidateView i_nodes = three_hop_candidates(src_router, dst_router);
 
     if (flag){
         cout << "candidate inodes for src " << src_router << " and dst " << dst_router << ":  ";
-        print_container(i_node_vector);
-    }   
-
-    
-    if (i_node_vector.size() != 0){
-        rdm_idx = RandomInt(i_node_vector.size() - 1); //RandomInt includes the limit
-        ret_val =  i_node_vector[rdm_idx]; 
-    }else{
-        ret_val =vlb_imdt_node_for_four_hop_paths(f, src_router, dst_router);
+        print_candidates(i_nodes);
     }
 
+    rdm_idx = RandomInt(i_nodes.count - 1); //RandomInt includes the limit
     
-    return ret_val;
-    
-  
-
-    
+    return i_nodes.nodes[rdm_idx];
 }
 
-void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalSwitch UGAL_SWITCH, DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void UGAL_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
     /*
     Vanilla UGAL_l routing function.
         
@@ -2801,7 +3603,7 @@ void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputS
     
     if (flag){
         cout << "inside UGAL_dragonflyfull() for flit: " << f-> id << endl;
-        cout << "routing mode: " << g_routing_mode << endl;
+        cout << "routing mode: " << g_routing_mode_names[g_routing_mode] << endl;
         cout << "hop_count: " << f->hop_count;
         cout << " vc: " << f->vc << endl;
         
@@ -2874,7 +3676,7 @@ void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputS
     
         //actual UGAL routing needs to happen here.
         
-        std::vector<int> pathVector;
+        DFPath pathVector;
         
         if (flag){
             cout << "dest router: " << dst_router << endl;
@@ -2882,7 +3684,7 @@ void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputS
         
         int temp; 
         
-        temp = select_UGAL_path(r, f, current_router, dst_router, pathVector, g_routing_mode);
+        temp = select_UGAL_path<SELECT_IMDT, VLB_SHORTEST_PATH, UGAL_SWITCH, MULTIPLY_MODE>(r, f, current_router, dst_router, pathVector);
         
         if (flag){
             cout << "select_ugal_path() returned: " << temp << endl;
@@ -2894,7 +3696,7 @@ void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputS
                 
         }
         //Save the whole path in the flit
-        f->path = std::move(pathVector);
+        f->path = pathVector;
         
         //now get the port to the next hop node 
         out_port = find_port_to_node(current_router, f->path[1]);
@@ -2916,7 +3718,7 @@ void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputS
         out_port = find_port_to_node(current_router, f->path[ f->hop_count + 1]);
         
         //assign vc 
-        if (g_vc_allocation_mode == "incremental"){
+        if (VC_MODE == DF_VC_INCREMENTAL){
             out_vc = f->hop_count;
         }
         else{
@@ -2943,6 +3745,28 @@ void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputS
     
 }
 
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalSwitch UGAL_SWITCH>
+void UGAL_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+    /*
+    What gets registered for every UGAL_L_* / UGAL_G_* routing function.
+    Same idea as vlb_dragonflyfull_kernel(): ugal_multiply_mode and 
+    vc_allocation_mode are config values, so pick the specialization here.
+    (UGAL_G does not use the multiplier, the extra instantiation is harmless.)
+    */
+    if (g_vc_allocation_mode == DF_VC_INCREMENTAL){
+        if (g_ugal_multiply_mode == DF_MULTIPLY_PATHLEN_BASED){
+            UGAL_route<SELECT_IMDT, VLB_SHORTEST_PATH, UGAL_SWITCH, DF_MULTIPLY_PATHLEN_BASED, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+        }else{
+            UGAL_route<SELECT_IMDT, VLB_SHORTEST_PATH, UGAL_SWITCH, DF_MULTIPLY_ONE_VS_TWO, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+        }
+    }else{
+        if (g_ugal_multiply_mode == DF_MULTIPLY_PATHLEN_BASED){
+            UGAL_route<SELECT_IMDT, VLB_SHORTEST_PATH, UGAL_SWITCH, DF_MULTIPLY_PATHLEN_BASED, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+        }else{
+            UGAL_route<SELECT_IMDT, VLB_SHORTEST_PATH, UGAL_SWITCH, DF_MULTIPLY_ONE_VS_TWO, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+        }
+    }
+}
 
 int allocate_vc(const Flit *f, int prev_router, int current_router, int next_router, int current_vc){
     
@@ -3010,7 +3834,88 @@ int allocate_vc(const Flit *f, int prev_router, int current_router, int next_rou
 }
 
 
-void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+template <DFVcAllocationMode VC_MODE>
+bool par_take_new_path(const Flit *f, const DFPath &new_path){
+    /*
+    Replace the part of f->path from the current router on with new_path
+    (which starts at the current router). The routers already visited stay
+    in front, the VC allocation looks back at them.
+
+    The new path is refused (returns false, f->path untouched) if the whole 
+    path would not fit in a DFPath, or if the VCs would run out before the
+    destination. The VCs only go up along a path, with both incremental and
+    allocate_vc(), and that is what keeps PAR deadlock free, so running out
+    is not an option.
+    */
+    int hop = f->hop_count;
+    int ii, vc;
+
+    if (hop + new_path.size() > DF_MAX_PATH_ROUTERS){
+        return false;
+    }
+
+    DFPath visited;
+    visited.assign(f->path.begin(), f->path.begin() + hop + 1);
+    
+    DFPath joined;
+    joined.join(visited, new_path);
+
+    //VC of the last hop, the same way the routing function will hand them out
+    if (VC_MODE == DF_VC_INCREMENTAL){
+        vc = joined.size() - 2;
+    }else{
+        vc = f->vc;
+        for(ii = hop; ii < (int)joined.size() - 1; ii++){
+            vc = allocate_vc(f, joined[ii - 1], joined[ii], joined[ii + 1], vc);
+        }
+    }
+    if (vc > gNumVCs - 1){
+        return false;
+    }
+
+    f->path = joined;
+    return true;
+}
+
+template <DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void par_revaluate_in_intermediate_group(const Router *r, const Flit *f, int current_router, int dst_router){
+    /*
+    The packet is on a VLB path, in the intermediate group. Compare the rest 
+    of its path with a MIN path from here, UGAL_L style, and switch if MIN wins.
+    Only the queue to the next router is looked at, same as at the source.
+    */
+    int remaining_hops = f->path.size() - 1 - f->hop_count;
+    int min_hops, min_q_len, remaining_q_len;
+    int min_multiplier, remaining_multiplier;
+    DFPath min_path;
+
+    require_shortest_path(select_shortest_path_djkstra(current_router, dst_router, min_path), current_router, dst_router);
+    min_hops = min_path.size() - 1;
+
+    if (min_hops >= remaining_hops){
+        return;     //nothing to gain, the rest of the path is already minimal
+    }
+
+    min_q_len = find_port_queue_len_to_node(r, current_router, min_path[1]);
+    remaining_q_len = find_port_queue_len_to_node(r, current_router, f->path[f->hop_count + 1]);
+
+    if (MULTIPLY_MODE == DF_MULTIPLY_ONE_VS_TWO){
+        min_multiplier = 1;
+        remaining_multiplier = 2;
+    }else{
+        min_multiplier = min_hops;
+        remaining_multiplier = remaining_hops;
+    }
+
+    if ((min_q_len * min_multiplier) <= (remaining_q_len * remaining_multiplier)){
+        if (par_take_new_path<VC_MODE>(f, min_path)){
+            f->PAR_need_to_revaluate = true;    //on a MIN path now. Out of the source group, so no more PAR.
+        }
+    }
+}
+
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void PAR_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
     /*
     PAR: Prograssive Adaptive routing function.
         
@@ -3085,7 +3990,7 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     
     if (flag){
         cout << "inside PAR_dragonflyfull() for flit: " << f-> id << endl;
-        cout << "routing mode: " << g_routing_mode << endl;
+        cout << "routing mode: " << g_routing_mode_names[g_routing_mode] << endl;
     }
     
     
@@ -3152,7 +4057,7 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     
         //actual UGAL routing needs to happen here.
         
-        std::vector<int> pathVector;
+        DFPath pathVector;
         
         if (flag){
             cout << "dest router: " << dst_router << endl;
@@ -3160,7 +4065,7 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
         
         int temp; 
         
-        temp = select_UGAL_path(r, f, current_router, dst_router, pathVector, g_routing_mode);
+        temp = select_UGAL_path<SELECT_IMDT, VLB_SHORTEST_PATH, DF_UGAL_LOCAL, MULTIPLY_MODE>(r, f, current_router, dst_router, pathVector);
         
         if (flag){
             cout << "select_ugal_path() returned: " << temp << endl;
@@ -3172,7 +4077,7 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
                 
         }
         //Save the whole path in the flit
-        f->path = std::move(pathVector);
+        f->path = pathVector;
         
         //now get the port to the next hop node 
         out_port = find_port_to_node(current_router, f->path[1]);
@@ -3189,100 +4094,61 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     
     }
   
-    else if ((f->hop_count == 1) && (f->PAR_need_to_revaluate == true)) {
-        //if it is out of source group already, PAR is not needed
+    else{  //neither src nor dst router. Packet in flight.
         int src_router = f->src / g_p;
         int src_group = src_router / g_a;
-
-        if ( (current_router >= (src_group*g_a)) && (current_router < (src_group*g_a + g_a) ) ){
-            //Still in the source group. PAR code goes here.
-
-            std::vector<int> pathVector;
-            int temp; 
-        
-            temp = select_UGAL_path(r, f, current_router, dst_router, pathVector, g_routing_mode);
-            
-            if (flag){
-                //cout << "inside PAR_dragonflyfull() for flit: " << f-> id << endl;
-                cout << "the complete path stored in the flit is: ";
-                    for(std::size_t ii = 0; ii < f->path.size(); ii++){
-                        cout << f->path[ii] << " ";
-                    }
-                    cout << endl;
-            }
-
-            //Path returned, now replace the old path with the new one.
-            
-            //Because we are saving the complete path in the flit, 
-            //it makes  sense to include the previous node as well.
-            pathVector.insert(pathVector.begin(), src_router);
-
-            f->path = std::move(pathVector);
-
-            out_port = find_port_to_node(current_router, f->path[f->hop_count + 1]);
+        int current_group = current_router / g_a;
+        int dst_group = dst_router / g_a;
+
+        //PAR_need_to_revaluate is set while the packet is on a MIN path.
+        //par_revaluation in the config says where the path may still change:
+        //  first_hop:    the second router, if still in the source group (the original PAR)
+        //  source_group: every router in the source group
+        //  source_and_intermediate_group: also every router of the intermediate group of a VLB path
+        bool in_source_scope = (f->PAR_need_to_revaluate == true) && (current_group == src_group) 
+                                && ((f->hop_count == 1) || (g_par_revaluation != DF_PAR_FIRST_HOP));
+        bool in_intermediate_scope = (g_par_revaluation == DF_PAR_SOURCE_AND_INTERMEDIATE_GROUP) && (f->PAR_need_to_revaluate == false)
+                                && (current_group != src_group) && (current_group != dst_group);
+
+        if (in_source_scope){
+            //Still in the source group on a MIN path. Run UGAL again from here.
+            DFPath pathVector;
+            int temp; 
         
-            //assign vc 
-            if (g_vc_allocation_mode == "incremental"){
-                out_vc = f->hop_count;
-            }
-            else{
-                prev_router = f->path[f->hop_count - 1];
-                next_router =  f->path[f->hop_count + 1];
-                out_vc = allocate_vc(f, prev_router, current_router, next_router, f->vc);
-            }
-
-            f->hop_count += 1;
-
+            temp = select_UGAL_path<SELECT_IMDT, VLB_SHORTEST_PATH, DF_UGAL_LOCAL, MULTIPLY_MODE>(r, f, current_router, dst_router, pathVector);
+            
             if (flag){
                 cout << "values returned from PAR: " << temp << endl;
-                cout << "the complete path: ";
+                cout << "the complete path stored in the flit is: ";
                     for(std::size_t ii = 0; ii < f->path.size(); ii++){
                         cout << f->path[ii] << " ";
                     }
                     cout << endl;
-                cout << "out port: " << out_port << endl;
-                cout << "vc: " << out_vc << endl;
-                cout << "hop count: " << f->hop_count << endl;
-            }
-        
-            
-
-        }else{
-            //PAR path correction not necessary. Business as usual.
-            //get port to the next hop node
-            out_port = find_port_to_node(current_router, f->path[ f->hop_count + 1]);
-            
-            //assign vc 
-            if (g_vc_allocation_mode == "incremental"){
-                out_vc = f->hop_count;
-            }
-            else{
-                prev_router = f->path[f->hop_count - 1];
-                next_router =  f->path[f->hop_count + 1];
-                out_vc = allocate_vc(f, prev_router, current_router, next_router, f->vc);
             }
 
-            
-            if (flag){
-                cout << "port to next hop: " << out_port << " through vc: " << out_vc << endl; 
+            //Path returned, now replace the rest of the old path with the new one.
+            //If it doesn't fit in the path or the VCs, stay on the old MIN path.
+            if (par_take_new_path<VC_MODE>(f, pathVector) == false){
+                f->PAR_need_to_revaluate = true;
             }
-            
-            //increase hop_count
-            f->hop_count += 1;
-            
+        }
+        else if (in_intermediate_scope){
+            par_revaluate_in_intermediate_group<MULTIPLY_MODE, VC_MODE>(r, f, current_router, dst_router);
         }
 
-        
-    }
-    else{  //neither src nor dst router. Packet in flight.
-        //get current hop count 
+        if (flag && (in_source_scope || in_intermediate_scope)){
+            cout << "the complete path after PAR: ";
+                for(std::size_t ii = 0; ii < f->path.size(); ii++){
+                    cout << f->path[ii] << " ";
+                }
+                cout << endl;
+        }
         
         //get port to the next hop node
         out_port = find_port_to_node(current_router, f->path[ f->hop_count + 1]);
         
         //assign vc 
-        //assign vc 
-        if (g_vc_allocation_mode == "incremental"){
+        if (VC_MODE == DF_VC_INCREMENTAL){
             out_vc = f->hop_count;
         }
         else{
@@ -3293,6 +4159,7 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
 
         if (flag){
             cout << "port to next hop: " << out_port << " through vc: " << out_vc << endl; 
+            cout << "hop count: " << f->hop_count + 1 << endl;
         }
         
         //increase hop_count
@@ -3307,8 +4174,256 @@ void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
     }    
 }
 
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH>
+void PAR_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+    //What gets registered for every PAR_* routing function. PAR always uses the UGAL_L comparison.
+    if (g_vc_allocation_mode == DF_VC_INCREMENTAL){
+        if (g_ugal_multiply_mode == DF_MULTIPLY_PATHLEN_BASED){
+            PAR_route<SELECT_IMDT, VLB_SHORTEST_PATH, DF_MULTIPLY_PATHLEN_BASED, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+        }else{
+            PAR_route<SELECT_IMDT, VLB_SHORTEST_PATH, DF_MULTIPLY_ONE_VS_TWO, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+        }
+    }else{
+        if (g_ugal_multiply_mode == DF_MULTIPLY_PATHLEN_BASED){
+            PAR_route<SELECT_IMDT, VLB_SHORTEST_PATH, DF_MULTIPLY_PATHLEN_BASED, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+        }else{
+            PAR_route<SELECT_IMDT, VLB_SHORTEST_PATH, DF_MULTIPLY_ONE_VS_TWO, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+        }
+    }
+}
+
+/*
+Per-hop routing.
+
+The *_perhop routing functions keep no path in the flit. The multi-phase fields
+Booksim flits already have are enough:
+    f->ph:      DF_PH_TO_INTERMEDIATE while heading to f->intm,
+                DF_PH_TO_DESTINATION after that (and for MIN from the start).
+    f->intm:    the i-node of a VLB route.
+The source router makes the MIN vs VLB choice and picks the i-node. Every router
+after that takes a random next hop towards the current target from
+g_next_hop_table. So both halves of a VLB route are djkstra minimal, whatever
+path flavor the source-routed version of the mode uses.
+*/
+template <imdt_node_selector_t SELECT_IMDT, DFPerHopChoice CHOICE, DFUgalMultiplyMode MULTIPLY_MODE>
+int perhop_source_choice(const Router *r, const Flit *f, int src_router, int dst_router){
+    /*
+    Sets f->ph and f->intm at the source router. Returns the next router.
+    
+    UGAL_L compares the first hops, like make_UGAL_L_path_choice(). The MIN
+    candidates are ugal_min_candidates draws of the first hop, the VLB
+    candidates are ugal_vlb_candidates i-nodes (fewer for a same-group packet
+    in a small group, see in_group_vlb_candidate_count()). Hop counts come from
+    g_next_hop_table.hops().
+    */
+    bool flag = false;
+    if (f->id == FLIT_TO_TRACK){
+        flag = true;
+    }
+
+    int ii;
+    int next_router, q_len;
+    bool same_group = (src_router / g_a) == (dst_router / g_a);
+    int imdt_nodes[DF_MAX_UGAL_CANDIDATES];
+    int chosen_tier = 0;
+
+    if (CHOICE == DF_PERHOP_MIN){
+        f->ph = DF_PH_TO_DESTINATION;
+        f->intm = -1;
+
+        g_total_min_flit += 1;
+        if (same_group){
+            g_min_ingroup_path_dist[g_next_hop_table.hops(src_router, dst_router)] += 1;
+        }else{
+            g_min_outgroup_path_dist[g_next_hop_table.hops(src_router, dst_router)] += 1;
+        }
+        return g_next_hop_table.next_router(g_graph, src_router, dst_router, RandomInt);
+    }
+
+    if (CHOICE == DF_PERHOP_VLB){
+        if (same_group){
+            imdt_nodes[0] = in_group_imdt_index_to_node(RandomInt(in_group_imdt_node_count(src_router, dst_router) - 1), src_router, dst_router);
+        }else{
+            generate_imdt_nodes<SELECT_IMDT>(f, src_router, dst_router, 1, imdt_nodes, -1);
+        }
+        f->ph = DF_PH_TO_INTERMEDIATE;
+        f->intm = imdt_nodes[0];
+
+        g_total_non_min_flit += 1;
+        int vlb_hops = g_next_hop_table.hops(src_router, imdt_nodes[0]) + g_next_hop_table.hops(imdt_nodes[0], dst_router);
+        if (same_group){
+            g_vlb_ingroup_path_dist[vlb_hops] += 1;
+        }else{
+            g_vlb_outgroup_path_dist[vlb_hops] += 1;
+        }
+        if (flag){
+            cout << "flit " << f->id << " perhop vlb " << src_router << " -> " << f->intm << " -> " << dst_router << endl;
+        }
+        return g_next_hop_table.next_router(g_graph, src_router, f->intm, RandomInt);
+    }
+
+    //DF_PERHOP_UGAL_L
+    int min_next = -1, vlb_next = -1, vlb_imdt = -1;
+    int min_q_len = 9999, vlb_q_len = 9999;    //arbitrary large number
+    int min_hops = g_next_hop_table.hops(src_router, dst_router);
+    int vlb_hops = 0, temp_hops;
+    int min_multiplier, vlb_multiplier;
+
+    for (ii = 0; ii < g_ugal_min_candidates; ii++){
+        next_router = g_next_hop_table.next_router(g_graph, src_router, dst_router, RandomInt);
+        q_len = find_port_queue_len_to_node(r, src_router, next_router);
+        if (q_len < min_q_len){
+            min_q_len = q_len;
+            min_next = next_router;
+        }
+    }
+
+    int no_of_vlb_candidates = g_ugal_vlb_candidates;
+    if (same_group){
+        no_of_vlb_candidates = in_group_vlb_candidate_count(src_router, dst_router);
+        DFIndexSampler sampler(in_group_imdt_node_count(src_router, dst_router));
+        for (ii = 0; ii < no_of_vlb_candidates; ii++){
+            imdt_nodes[ii] = in_group_imdt_index_to_node(sampler.draw(), src_router, dst_router);
+        }
+    }else{
+        chosen_tier = generate_imdt_nodes<SELECT_IMDT>(f, src_router, dst_router, no_of_vlb_candidates, imdt_nodes, min_q_len);
+    }
+
+    for (ii = 0; ii < no_of_vlb_candidates; ii++){
+        next_router = g_next_hop_table.next_router(g_graph, src_router, imdt_nodes[ii], RandomInt);
+        q_len = find_port_queue_len_to_node(r, src_router, next_router);
+        temp_hops = g_next_hop_table.hops(src_router, imdt_nodes[ii]) + g_next_hop_table.hops(imdt_nodes[ii], dst_router);
+        if (q_len < vlb_q_len){
+            vlb_q_len = q_len;
+            vlb_next = next_router;
+            vlb_imdt = imdt_nodes[ii];
+            vlb_hops = temp_hops;
+        }
+    }
+
+    if (MULTIPLY_MODE == DF_MULTIPLY_ONE_VS_TWO){
+        min_multiplier = 1;
+        vlb_multiplier = 2;
+    }else{
+        min_multiplier = min_hops;
+        vlb_multiplier = vlb_hops;
+    }
+
+    if (flag){
+        cout << "flit " << f->id << " perhop ugal min q: " << min_q_len << " x " << min_multiplier << " , vlb q: " << vlb_q_len << " x " << vlb_multiplier << " via " << vlb_imdt << endl;
+    }
+
+    if ((min_q_len * min_multiplier) <= (vlb_q_len * vlb_multiplier)){
+        f->ph = DF_PH_TO_DESTINATION;
+        f->intm = -1;
+
+        g_total_min_flit += 1;
+        g_cases_when_not_taken[chosen_tier] += 1;
+        g_lens_when_not_taken[vlb_hops] += 1;
+        if (same_group){
+            g_min_ingroup_path_dist[min_hops] += 1;
+        }else{
+            g_min_outgroup_path_dist[min_hops] += 1;
+        }
+        log_ugal_stats(0, min_multiplier, vlb_multiplier);
+        return min_next;
+    }
+
+    f->ph = DF_PH_TO_INTERMEDIATE;
+    f->intm = vlb_imdt;
+
+    g_total_non_min_flit += 1;
+    g_cases_when_taken[chosen_tier] += 1;
+    g_lens_when_taken[vlb_hops] += 1;
+    if (same_group){
+        g_vlb_ingroup_path_dist[vlb_hops] += 1;
+    }else{
+        g_vlb_outgroup_path_dist[vlb_hops] += 1;
+    }
+    log_ugal_stats(1, min_multiplier, vlb_multiplier);
+    return vlb_next;
+}
+
+template <imdt_node_selector_t SELECT_IMDT, DFPerHopChoice CHOICE, DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void perhop_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+    /*
+    Same port and vc logic as vlb_route(), with the next router from 
+    perhop_source_choice() at the source and from g_next_hop_table after that.
+    For allocate_vc() the previous router is the one behind in_channel.
+    */
+    if(inject) {
+        outputs->Clear( );
+        int inject_vc= RandomInt(gNumVCs-1);
+        outputs->AddRange(-1, inject_vc, inject_vc);
+        return;
+    }
+
+    outputs -> Clear();
+
+    int current_router = r->GetID();
+    int next_router;
+    int target_router;
+    int out_port;
+    int out_vc;
+
+    int dst_PE = f->dest;
+    int dst_router = dst_PE / g_p;
+
+    if(current_router == dst_router){
+        out_vc = RandomInt(gNumVCs-1);
+        out_port = dst_PE % g_p;
+        g_total_flit += 1;
+    }
+    else if (f->hop_count == 0){   //source router
+        next_router = perhop_source_choice<SELECT_IMDT, CHOICE, MULTIPLY_MODE>(r, f, current_router, dst_router);
+        out_port = find_port_to_node(current_router, next_router);
+        out_vc = 0;
+        f->hop_count += 1;
+    }
+    else{   //packet in flight
+        if ((f->ph == DF_PH_TO_INTERMEDIATE) && (current_router == f->intm)){
+            f->ph = DF_PH_TO_DESTINATION;
+        }
+        target_router = (f->ph == DF_PH_TO_INTERMEDIATE) ? f->intm : dst_router;
+
+        next_router = g_next_hop_table.next_router(g_graph, current_router, target_router, RandomInt);
+        out_port = find_port_to_node(current_router, next_router);
+
+        if (VC_MODE == DF_VC_INCREMENTAL){
+            out_vc = f->hop_count;
+        }
+        else{
+            int prev_router = g_input_port_router[(std::size_t)current_router * g_radix + in_channel];
+            out_vc = allocate_vc(f, prev_router, current_router, next_router, f->vc);
+        }
+
+        f->hop_count += 1;
+    }
+
+    outputs->AddRange( out_port, out_vc, out_vc );
+}
+
+template <imdt_node_selector_t SELECT_IMDT, DFPerHopChoice CHOICE>
+void perhop_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject){
+    //What gets registered for every *_perhop routing function. Same dispatch as UGAL_dragonflyfull_kernel().
+    if (g_vc_allocation_mode == DF_VC_INCREMENTAL){
+        if (g_ugal_multiply_mode == DF_MULTIPLY_PATHLEN_BASED){
+            perhop_route<SELECT_IMDT, CHOICE, DF_MULTIPLY_PATHLEN_BASED, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+        }else{
+            perhop_route<SELECT_IMDT, CHOICE, DF_MULTIPLY_ONE_VS_TWO, DF_VC_INCREMENTAL>(r, f, in_channel, outputs, inject);
+        }
+    }else{
+        if (g_ugal_multiply_mode == DF_MULTIPLY_PATHLEN_BASED){
+            perhop_route<SELECT_IMDT, CHOICE, DF_MULTIPLY_PATHLEN_BASED, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+        }else{
+            perhop_route<SELECT_IMDT, CHOICE, DF_MULTIPLY_ONE_VS_TWO, DF_VC_OPTIMAL>(r, f, in_channel, outputs, inject);
+        }
+    }
+}
+
 
-int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_router, std::vector<int> & pathVector, string routing_mode){
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalSwitch UGAL_SWITCH, DFUgalMultiplyMode MULTIPLY_MODE>
+int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_router, DFPath & pathVector){
     /*
         Vanilla UGAL_L routing, but a twist can be added using routing_mode.
         
@@ -3338,16 +4453,18 @@ int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_ro
         cout << "inside select_UGAL_path() for flit " << f->id << endl;
     }
     
-    int no_of_MIN_paths_to_consider = 1;        
-                            //At present it doesn't support any other value.
-                            //But can change this in future
-
-    int no_of_VLB_paths_to_consider = 1;  //can change this in future 
+    int no_of_MIN_paths_to_consider = g_ugal_min_candidates;
+    int no_of_VLB_paths_to_consider = g_ugal_vlb_candidates;
+                            //ugal_min_candidates / ugal_vlb_candidates in the config.
+                            //_setGlobals() made sure they fit in DF_MAX_UGAL_CANDIDATES.
     
     int ii, temp, chosen_pathID;
         
-    std::vector< std::vector<int> > paths;
-    std::vector<int> imdt_nodes;
+    //candidates live on the stack, min paths first, then the VLB paths.
+    //Nothing below allocates, whatever the no of candidates.
+    DFPath paths[DF_MAX_UGAL_CANDIDATES];
+    int imdt_nodes[DF_MAX_UGAL_CANDIDATES];
+    int no_of_paths;
     
     int min_q_len;
     int chosen_tier = 0; //only useful for multi-tiered routing
@@ -3355,43 +4472,44 @@ int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_ro
     //this block is to take care fo the PAR second-hop revaluation special case.
     if (f->PAR_need_to_revaluate == true){
         no_of_MIN_paths_to_consider = 1;
-            //at this point, it is redundant. 
-            //But in future if we support more that one min paths,
-            //the resetting it to 1 here would be crucial.
+            //the revaluation compares the one djkstra min path against the VLB ones.
     }
 
-
-    paths.resize(no_of_MIN_paths_to_consider + no_of_VLB_paths_to_consider); 
-                        //1 min path, the rest non-min paths
-    imdt_nodes.resize(no_of_VLB_paths_to_consider, -1);
+    no_of_paths = no_of_MIN_paths_to_consider + no_of_VLB_paths_to_consider; 
         
     //individual paths need not be initialized, as select_shortest_path() and select_vlb_path_regular() initialize the vectors themselves.
     
-        
-    //TODO: this might be more generalized to select more than one min paths
-    
-    //get the shortest path
-    if (f->PAR_need_to_revaluate == true){
-        if (flag){
-            cout << "using djkstra shortest path. " << endl;
+    //get the shortest paths. Each call picks one at random, so with more than one
+    //min candidate the same path may come up twice. That only costs a compare.
+    for(ii = 0; ii < no_of_MIN_paths_to_consider; ii++){
+        if (f->PAR_need_to_revaluate == true){
+            if (flag){
+                cout << "using djkstra shortest path. " << endl;
+            }
+            temp = select_shortest_path_djkstra(src_router, dst_router, paths[ii]);
+        }
+        else{
+            temp = select_shortest_path(src_router, dst_router, paths[ii]);
         }
-        temp = select_shortest_path_djkstra(src_router, dst_router, paths[0]);
-    }
-    else{
-        temp = select_shortest_path(src_router, dst_router, paths[0]);
-    }
 
-    if (flag){
-        cout << "select_shortest_path() returned " << temp << endl;
-    }
+        if (flag){
+            cout << "select_shortest_path() returned " << temp << endl;
+        }
 
-    if (temp != 1){
-        cout << "Error! No min path found. Exiting." << endl;
-        exit(-1);
+        if (temp != 1){
+            cout << "Error! No min path found. Exiting." << endl;
+            exit(-1);
+        }
     }
     
-    //get the q_len to the shortest path
+    //get the q_len to the shortest paths. The threshold modes look at the best one.
     min_q_len = find_port_queue_len_to_node(r, paths[0][0], paths[0][1]);
+    for(ii = 1; ii < no_of_MIN_paths_to_consider; ii++){
+        temp = find_port_queue_len_to_node(r, paths[ii][0], paths[ii][1]);
+        if (temp < min_q_len){
+            min_q_len = temp;
+        }
+    }
     
 
     //Now, get the non-min paths
@@ -3404,22 +4522,21 @@ int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_ro
     //First, check if src and dst are in the same group
     if (src_group == dst_group){
     //if(0 == 1){
-        if (no_of_VLB_paths_to_consider > (g_a - 2)){
-            cout << "Error: not enough in-group nodes to choose from. Exiting." << endl;
-            exit(-9); //-9 is just an error flag. no other meaning.
-        }
+        //a small group may have fewer in-group nodes than ugal_vlb_candidates
+        no_of_VLB_paths_to_consider = in_group_vlb_candidate_count(src_router, dst_router);
+        no_of_paths = no_of_MIN_paths_to_consider + no_of_VLB_paths_to_consider;
 
         //select in-group nodes only as imdt nodes
-        generate_in_group_vlb_paths(f, src_router, dst_router, no_of_VLB_paths_to_consider, paths.begin()+no_of_MIN_paths_to_consider, paths.end());
+        generate_in_group_vlb_paths(f, src_router, dst_router, paths + no_of_MIN_paths_to_consider, paths + no_of_paths);
 
     }else{
 
-        chosen_tier = generate_imdt_nodes(f, src_router, dst_router, no_of_VLB_paths_to_consider, imdt_nodes, routing_mode, min_q_len);
+        chosen_tier = generate_imdt_nodes<SELECT_IMDT>(f, src_router, dst_router, no_of_VLB_paths_to_consider, imdt_nodes, min_q_len);
         if (flag){
             cout << "chosen_tier " << chosen_tier << endl;
             cout << "selected imdt nodes:";
-            for(std::size_t jj = 0; jj < imdt_nodes.size(); jj++){
-                cout << imdt_nodes[jj] << " ";
+            for(ii = 0; ii < no_of_VLB_paths_to_consider; ii++){
+                cout << imdt_nodes[ii] << " ";
             }
             cout << endl;
         }
@@ -3427,22 +4544,16 @@ int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_ro
         for(ii = 0; ii < no_of_VLB_paths_to_consider; ii++){
 
 
-            if ((g_routing_mode == "restricted_src_only") || (g_routing_mode == "restricted_src_and_dst") || ( routing_mode == "four_hop_restricted") || ( routing_mode == "three_hop_restricted")  || ( routing_mode == "four_hop_some_five_hop_restricted")){
-           
-                //generate djkstra paths
-                generate_vlb_path_from_given_imdt_node(src_router, dst_router, imdt_nodes[ii], paths[ii+no_of_MIN_paths_to_consider], "djkstra");
-            }
-            else{
-                generate_vlb_path_from_given_imdt_node(src_router, dst_router, imdt_nodes[ii], paths[ii+no_of_MIN_paths_to_consider], "generic"); 
+            //djkstra paths for the restricted modes, df_min paths otherwise.
+            generate_vlb_path_from_given_imdt_node(src_router, dst_router, imdt_nodes[ii], paths[ii+no_of_MIN_paths_to_consider], VLB_SHORTEST_PATH); 
                             //the first no_of_MIN_paths_to_consider element in paths[] array is used for min path
-            }
         }
     }
 
     if (flag){
         cout << "generate_vlb_path_from_given_imdt_node() returned " << endl;
         cout << "genrated paths:" << endl;
-        for(std::size_t jj = 0; jj < paths.size(); jj++){
+        for(int jj = 0; jj < no_of_paths; jj++){
             cout << "path " << jj << " : ";
             for(std::size_t kk=0; kk < paths[jj].size(); kk++){
                 cout << paths[jj][kk] << " ";
@@ -3452,12 +4563,12 @@ int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_ro
     }
     
     //paths generated, now compare Q length and select one
-    if (g_ugal_local_vs_global_switch == "local"){
-        chosen_pathID = make_UGAL_L_path_choice(r, f, no_of_MIN_paths_to_consider, no_of_VLB_paths_to_consider, paths, chosen_tier);
-    }else if (g_ugal_local_vs_global_switch == "global"){
+    if (UGAL_SWITCH == DF_UGAL_LOCAL){
+        chosen_pathID = make_UGAL_L_path_choice<MULTIPLY_MODE>(r, f, no_of_MIN_paths_to_consider, no_of_VLB_paths_to_consider, paths, chosen_tier);
+    }else if (UGAL_SWITCH == DF_UGAL_GLOBAL){
         chosen_pathID = make_UGAL_G_path_choice(r, f, no_of_MIN_paths_to_consider, no_of_VLB_paths_to_consider, paths, chosen_tier);
     }else{
-        cout << "Error. invalid g_ugal_local_vs_global_switch value: " << g_ugal_local_vs_global_switch << endl;
+        cout << "Error. invalid ugal local vs global switch value: " << UGAL_SWITCH << endl;
         exit(-1);
     }
     
@@ -3472,25 +4583,24 @@ int select_UGAL_path( const Router *r, const Flit *f, int src_router, int dst_ro
 
     //decide here if a min path was selected in UGAL. If yes, mark it for PAR routing.
         
-    if (chosen_pathID < no_of_MIN_paths_to_consider){
-        f->PAR_need_to_revaluate = true;
+    //Cleared again if PAR re-evaluation moved the packet to a VLB path, 
+    //so the flag always tells if the packet is on a MIN path.
+    f->PAR_need_to_revaluate = (chosen_pathID < no_of_MIN_paths_to_consider);
                 //for PAR routing only. For others, it will have no effect.
-    }
 
 
     //Now copy the chosen path in pathVector
-    pathVector = paths[chosen_pathID];  //vector assignment operator invokes a deep copy, so safe.
+    pathVector = paths[chosen_pathID];  //DFPath is stored inline, plain copy.
     
     return 1;   //to indicate success, no other significance at this moment.
 }
 
-int generate_in_group_vlb_paths(const Flit *f, int src_router, int dst_router, int no_of_nodes_to_generate, std::vector< std::vector<int> >::iterator start, std::vector< std::vector<int> >::iterator finish){
+int generate_in_group_vlb_paths(const Flit *f, int src_router, int dst_router, DFPath *start, DFPath *finish){
 
     //we already checked that there are enough in group nodes to choose from.
 
-    //Repeat no_of_nodes_to_generate times
-        //Randomly choose an inter-group nodes.
-        //if it is equal to src, dst, or any other node previously encountered, discard it and re-do.
+    //Fill [start, finish) with paths through distinct routers of the group other than src and dst,
+    //drawn without replacement (DFIndexSampler), so no retries.
     bool flag = false;
 
     if (f->id == FLIT_TO_TRACK){
@@ -3502,36 +4612,20 @@ int generate_in_group_vlb_paths(const Flit *f, int src_router, int dst_router, i
         cout << "src_router: " << src_router << " , dst_router: " << dst_router << endl;   
     }
 
-    std::unordered_set <int> node_cache;
-    int ii;
-    int src_group = src_router / g_a;
-    int imdt_node = -1;
+    DFIndexSampler sampler(in_group_imdt_node_count(src_router, dst_router));
+    int imdt_node;
 
-    for(ii = 0; ii < no_of_nodes_to_generate; ii++){
-        while( (imdt_node == -1) ||(imdt_node == src_router) || (imdt_node == dst_router) ||( node_cache.find(imdt_node) != node_cache.end())){
-                imdt_node = src_group * g_a + RandomInt(g_a - 1); //RandomInt gets a number in the range[0,max], inclusive.
-                
-                
-                if (flag){
-                    cout << "imdt_node generated: " << imdt_node << endl;
-                }
-        }
-        node_cache.insert(imdt_node);
-    }
-    
-    if (flag){
-        cout << "generated imdt nodes: ";
-        for(auto it = node_cache.begin(); it != node_cache.end(); it++){
-            cout << *it << " ";
+    for(DFPath *it = start; it != finish; it++){
+        imdt_node = in_group_imdt_index_to_node(sampler.draw(), src_router, dst_router);
+        
+        if (flag){
+            cout << "imdt_node generated: " << imdt_node << endl;
         }
-        cout << endl;
-    }
-
-    auto it2 = node_cache.begin();
-    for(auto it = start; it != finish; it++, it2++){
-        (*it).push_back(src_router);
-        (*it).push_back(*it2);
-        (*it).push_back(dst_router);
+        
+        it->clear();
+        it->push_back(src_router);
+        it->push_back(imdt_node);
+        it->push_back(dst_router);
     }
 
     if(flag){
@@ -3543,17 +4637,26 @@ int generate_in_group_vlb_paths(const Flit *f, int src_router, int dst_router, i
 }
 
 
-int generate_imdt_nodes(const Flit *f, int src_router, int dst_router, int no_of_nodes_to_generate, std::vector<int> & imdt_nodes, string routing_mode, int min_q_len){
+#define DF_MAX_IMDT_NODE_DRAWS 64
+
+template <imdt_node_selector_t SELECT_IMDT>
+int generate_imdt_nodes(const Flit *f, int src_router, int dst_router, int no_of_nodes_to_generate, int *imdt_nodes, int min_q_len){
     /*
     A function that generates a list of intermeaidate nodes to generate VLB paths through, 
     for a given src_router and dst_router.
     
-    Depending on routing_mode, different functions are called to generate intermeaidate nodes.
+    Depending on routing mode, different functions are called to generate intermeaidate nodes.
+    The selector is a template parameter, picked per registered routing function
+    in g_routing_function_table.
     
     The general constraints are:
         1) The generated nodes need to be unique
         2) A intermediate group can not belong to the same group as src or dst.
     
+    For the vanilla selector both constraints are just "outside src and dst groups",
+    so the nodes are drawn without replacement from that range (DFIndexSampler)
+    instead of retrying on duplicates.
+    
     The flit is passed just for debugging.
     */
     
@@ -3563,92 +4666,57 @@ int generate_imdt_nodes(const Flit *f, int src_router, int dst_router, int no_of
         flag = true;
     }
 
-    std::unordered_set<int> node_cache;
-    int ii;
-    int imdt_node = -1;
+    int ii, jj;
+    int imdt_node;
+    bool duplicate;
 
     int chosen_tier = 0; //only needed for multi-tiered routing.
 
+    if (SELECT_IMDT == &imdt_node_multitiered){
+        //same tier imdt_node_multitiered() picks the nodes from
+        chosen_tier = multitiered_tier(min_q_len);
+    }
+
     if (flag){
         cout << "no_of_nodes_to_generate: " << no_of_nodes_to_generate << endl;
-        cout << "routing mode: " << routing_mode << endl;
+        cout << "routing mode: " << g_routing_mode_names[g_routing_mode] << endl;
     }    
 
-    //routing modes: vanilla_ugal, two_hop, threshold,  not_applicable
-    for(ii = 0; ii < no_of_nodes_to_generate; ii++){
-        while( (imdt_node == -1) || ( node_cache.find(imdt_node) != node_cache.end() ) ){
-
-            if (routing_mode == "vanilla" ){
-                imdt_node = vlb_intermediate_node_vanilla(f, src_router, dst_router);
-                if (flag){
-                    cout << "intermediate node generator function returned: " << imdt_node << endl; 
-                }
-            }
-
-
-            else if( (routing_mode == "restricted_src_and_dst") ) {
-                imdt_node = vlb_imdt_node_for_five_hop_paths_src_and_dst(f, src_router, dst_router);
-                if (flag){
-                    cout << "intermediate node generator function returned: " << imdt_node << endl; 
-                }
-            }
-
-            else if( (routing_mode == "two_hop") || (routing_mode == "restricted_src_only") ){
-                //imdt_node = vlb_imdt_node_for_five_hop_paths_src_only(f, src_router, dst_router);
-                imdt_node = vlb_imdt_node_for_five_hop_paths_src_only(f, src_router, dst_router);
-                if (flag){
-                    cout << "intermediate node generator function returned: " << imdt_node << endl; 
-                }
-            }
-
-            else if (routing_mode == "four_hop_restricted") {
-                imdt_node = vlb_imdt_node_for_four_hop_paths(f, src_router, dst_router);
-                if (flag){
-                    cout << "intermediate node generator function returned:" << imdt_node << endl; 
-                }
+    if (SELECT_IMDT == &imdt_node_vanilla){
+        int src_group = src_router / g_a;
+        int dst_group = dst_router / g_a;
+        DFIndexSampler sampler(vanilla_imdt_node_count(src_group, dst_group));
+        
+        for(ii = 0; ii < no_of_nodes_to_generate; ii++){
+            imdt_nodes[ii] = vanilla_imdt_index_to_node(sampler.draw(), src_group, dst_group);
+            if (flag){
+                cout << "intermediate node drawn: " << imdt_nodes[ii] << endl; 
             }
+        }
+        return chosen_tier;
+    }
 
-            else if (routing_mode == "three_hop_restricted") {
-                imdt_node = vlb_imdt_node_for_three_hop_paths(f, src_router, dst_router);
-            }
-            else if (routing_mode == "four_hop_some_five_hop_restricted") {
-                imdt_node = vlb_imdt_node_for_four_hop_and_some_five_hop_paths(f, src_router, dst_router, g_five_hop_percentage);
-                if (flag){
-                    cout << "intermediate node generator function returned:" << imdt_node << endl; 
-                }
+    //at most DF_MAX_UGAL_CANDIDATES nodes, so duplicates are checked against the
+    //nodes already picked instead of a set.
+    //Some pairs have fewer candidate i-nodes than ugal_vlb_candidates (e.g. three_hop_restricted).
+    //After DF_MAX_IMDT_NODE_DRAWS tries a duplicate is kept, it only repeats a compare.
+    int draws;
+    for(ii = 0; ii < no_of_nodes_to_generate; ii++){
+        draws = 0;
+        do{
+            draws++;
+            imdt_node = SELECT_IMDT(f, src_router, dst_router, min_q_len);
+            if (flag){
+                cout << "intermediate node generator function returned: " << imdt_node << endl; 
             }
-
-            else if(routing_mode == "threshold"){
-                //compare the q_len of min path with the threshold value.
-                //if it is smaller, keep using two-hop nodes.
-                //if it is greater, revert to vanilla UGAL.
-                if (flag){
-                    cout << "min_q_len " << min_q_len << endl; 
-                    cout << "g_threshold " << g_threshold << endl; 
-                
-                }
-                if (min_q_len < g_threshold){
-                    //imdt_node = vlb_imdt_node_for_five_hop_paths_src_only(f, src_router, dst_router);
-                    imdt_node = vlb_imdt_node_for_five_hop_paths_src_only(f, src_router, dst_router);
-                    if (flag){
-                        cout << "intermediate node generator function returned: " << imdt_node << endl;        
-                    }
-                }else{
-                    imdt_node = vlb_intermediate_node_vanilla(f, src_router, dst_router);
-                    if (flag){
-                        cout << "intermediate node generator function returned:" << imdt_node << endl; 
-                    }
+            duplicate = false;
+            for(jj = 0; jj < ii; jj++){
+                if (imdt_nodes[jj] == imdt_node){
+                    duplicate = true;
+                    break;
                 }
-                
-            }
-            
-            
-            else{
-                cout << "Error! Unsupported routing_mode: " << routing_mode << " ! Exiting." << endl;
-                exit(-1);
             }
-        }
-        node_cache.insert(imdt_node);
+        }while( (imdt_node == -1) || (duplicate && (draws < DF_MAX_IMDT_NODE_DRAWS)) );
         imdt_nodes[ii] = imdt_node;
     }
     return chosen_tier; 
@@ -3658,7 +4726,86 @@ int generate_imdt_nodes(const Flit *f, int src_router, int dst_router, int no_of
 }
 
 
+/*
+Adapters that give every intermediate node selector the same signature, so that 
+they can be template arguments of the routing kernels. min_q_len is only used by
+the threshold and multitiered modes.
+*/
+int imdt_node_vanilla(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    return vlb_intermediate_node_vanilla(f, src_router, dst_router);
+}
+
+int imdt_node_five_hop_src_only(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    return vlb_imdt_node_for_five_hop_paths_src_only(f, src_router, dst_router);
+}
+
+int imdt_node_five_hop_src_and_dst(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    return vlb_imdt_node_for_five_hop_paths_src_and_dst(f, src_router, dst_router);
+}
+
+int imdt_node_four_hop(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    return vlb_imdt_node_for_four_hop_paths(f, src_router, dst_router);
+}
+
+int imdt_node_three_hop(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    return vlb_imdt_node_for_three_hop_paths(f, src_router, dst_router);
+}
+
+int imdt_node_four_hop_some_five_hop(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    return vlb_imdt_node_for_four_hop_and_some_five_hop_paths(f, src_router, dst_router, g_five_hop_percentage);
+}
+
+int imdt_node_threshold(const Flit *f, int src_router, int dst_router, int min_q_len){
+    //compare the q_len of min path with the threshold value.
+    //if it is smaller, keep using two-hop nodes.
+    //if it is greater, revert to vanilla UGAL.
+    if (min_q_len < g_threshold){
+        return vlb_imdt_node_for_five_hop_paths_src_only(f, src_router, dst_router);
+    }else{
+        return vlb_intermediate_node_vanilla(f, src_router, dst_router);
+    }
+}
+
+int multitiered_tier(int min_q_len){
+    /*
+    Tier of the multi-tiered routing for a given min path q_len:
+        1: q_len < multitiered_routing_threshold_0, three hop VLB paths
+        2: q_len < multitiered_routing_threshold_1, four hop VLB paths
+        3: otherwise, any i-node (five/six hop VLB paths as well)
+    */
+    if (min_q_len < g_multitiered_threshold_0){
+        return 1;
+    }else if (min_q_len < g_multitiered_threshold_1){
+        return 2;
+    }else{
+        return 3;
+    }
+}
+
+int imdt_node_multitiered(const Flit *f, int src_router, int dst_router, int min_q_len){
+    //Lightly loaded min path -> stay with the shortest VLB paths.
+    //The more the min path is loaded, the more i-nodes (and longer paths) are allowed,
+    //up to all of them, so the saturation throughput is the same as vanilla.
+    switch (multitiered_tier(min_q_len)){
+        case 1:
+            return vlb_imdt_node_for_three_hop_paths(f, src_router, dst_router);
+        case 2:
+            return vlb_imdt_node_for_four_hop_paths(f, src_router, dst_router);
+        default:
+            return vlb_intermediate_node_vanilla(f, src_router, dst_router);
+    }
+}
+
+int imdt_node_table(const Flit *f, int src_router, int dst_router, int /*min_q_len*/){
+    //One of the i-nodes the offline optimizer kept for this pair.
+    //A pair the table has nothing for falls back to any i-node.
+    DFCandidateView i_nodes = g_vlb_inode_table.get(src_router, dst_router);
 
+    if (i_nodes.count == 0){
+        return vlb_intermediate_node_vanilla(f, src_router, dst_router);
+    }
+    return i_nodes.nodes[RandomInt(i_nodes.count - 1)]; //RandomInt includes the limit
+}
 
 int vlb_imdt_node_for_four_hop_paths_old(const Flit *f, int src_router, int dst_router){
 
@@ -3763,12 +4910,13 @@ int vlb_imdt_node_for_four_hop_paths_old(const Flit *f, int src_router, int dst_
 
 
 
-int make_UGAL_L_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, std::vector< std::vector<int> > paths, int chosen_tier){
+template <DFUgalMultiplyMode MULTIPLY_MODE>
+int make_UGAL_L_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, const DFPath *paths, int chosen_tier){
     /* 
     At this moment, we are just considering min path weight as 1
     and non-min path weight as 2.
-        Update: After update, now it is being controlled by the global variable
-        g_ugal_multiply_mode. Based on its value, the multipliers can be 1 vs 2
+        Update: After update, now it is being controlled by the template 
+        parameter MULTIPLY_MODE (ugal_multiply_mode in the config). Based on its value, the multipliers can be 1 vs 2
         or min_hop_count vs vlb_hop_count.
     
     The flit is passed for debugging. 
@@ -3837,15 +4985,14 @@ int make_UGAL_L_path_choice(const Router *r, const Flit *f, int no_of_min_paths_
     }
     
     
-    if (g_ugal_multiply_mode == "one_vs_two"){
+    if (MULTIPLY_MODE == DF_MULTIPLY_ONE_VS_TWO){
         min_multiplier = 1;
         vlb_multiplier = 2;
-    }else if(g_ugal_multiply_mode == "pathlen_based"){
+    }else{
+        //_setRoutingMode() already rejected anything other than one_vs_two
+        //and pathlen_based for UGAL_L.
         min_multiplier = selected_min_path_hop_count;
         vlb_multiplier = selected_VLB_path_hop_count;
-    } else{
-        cout << "Erorr! Unsupported ugal_multiply_mode: " << g_ugal_multiply_mode << " . Exiting." << endl;
-        exit(-1);
     }
 
     //make comparison
@@ -3920,7 +5067,7 @@ int make_UGAL_L_path_choice(const Router *r, const Flit *f, int no_of_min_paths_
     return chosen_path_id;
 }
 
-int make_UGAL_G_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, std::vector< std::vector<int> > paths, int chosen_tier){
+int make_UGAL_G_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, const DFPath *paths, int chosen_tier){
     /*
     chosen_tier is only here for some legacy stat-collection code. Not required
     at all.
@@ -4075,7 +5222,12 @@ int find_port_queue_len_to_node(const Router *r, int current_router, int next_ro
     While forwarding a node, we can select a Q randomly.     
     */
     
-    auto port_range = g_port_map[std::make_pair(current_router, next_router)];
+    int first_port, last_port;
+    port_range_to_node(current_router, next_router, first_port, last_port);
+
+    if (first_port == last_port){
+        return r->GetUsedCredit(first_port);
+    }
     
     //then check its Q_length
     int port_id;
@@ -4083,7 +5235,7 @@ int find_port_queue_len_to_node(const Router *r, int current_router, int next_ro
     int queue_length = 0;
     int count = 0;
         
-    for (port_id = port_range.first; port_id <= port_range.second; port_id++) {
+    for (port_id = first_port; port_id <= last_port; port_id++) {
         //port_range is a closed range
         queue_length += r->GetUsedCredit(port_id);
         count += 1;
@@ -4,10 +4,73 @@
 #include "network.hpp"
 #include "routefunc.hpp"
 #include "pair_hash.hpp"
+#include "df_path.hpp"
+#include "df_graph.hpp"
 
 #include <string>
 
 
+/*
+Routing switches. _setRoutingMode() resolves the routing_function, ugal_multiply_mode
+and vc_allocation_mode strings into these once at construction, so the per-packet
+routing code only ever compares small integers.
+*/
+enum DFRoutingMode {
+    DF_MODE_NOT_APPLICABLE = 0,
+    DF_MODE_VANILLA,
+    DF_MODE_TWO_HOP,
+    DF_MODE_RESTRICTED_SRC_ONLY,
+    DF_MODE_RESTRICTED_SRC_AND_DST,
+    DF_MODE_FOUR_HOP_RESTRICTED,
+    DF_MODE_THREE_HOP_RESTRICTED,
+    DF_MODE_FOUR_HOP_SOME_FIVE_HOP_RESTRICTED,
+    DF_MODE_THRESHOLD,
+    DF_MODE_MULTITIERED,
+    DF_MODE_TABLE,
+    DF_NUM_ROUTING_MODES
+};
+
+enum DFUgalSwitch {
+    DF_UGAL_NOT_APPLICABLE = 0,
+    DF_UGAL_LOCAL,
+    DF_UGAL_GLOBAL
+};
+
+enum DFUgalMultiplyMode {
+    DF_MULTIPLY_UNSUPPORTED = 0,
+    DF_MULTIPLY_ONE_VS_TWO,
+    DF_MULTIPLY_PATHLEN_BASED
+};
+
+enum DFVcAllocationMode {
+    DF_VC_INCREMENTAL = 0,
+    DF_VC_OPTIMAL       //anything other than "incremental" goes through allocate_vc()
+};
+
+//where PAR may still change the path of a packet, par_revaluation in the config
+enum DFParRevaluation {
+    DF_PAR_FIRST_HOP = 0,               //second router of a MIN path, in the source group
+    DF_PAR_SOURCE_GROUP,                //any router of a MIN path in the source group
+    DF_PAR_SOURCE_AND_INTERMEDIATE_GROUP    //and any router of a VLB path in its intermediate group
+};
+
+//what the source router of a *_perhop routing function decides between
+enum DFPerHopChoice {
+    DF_PERHOP_MIN = 0,
+    DF_PERHOP_VLB,
+    DF_PERHOP_UGAL_L
+};
+
+//f->ph of the *_perhop routing functions
+enum DFPerHopPhase {
+    DF_PH_TO_INTERMEDIATE = 1,  //heading to f->intm
+    DF_PH_TO_DESTINATION        //heading to the destination router
+};
+
+//upper bound on ugal_min_candidates + ugal_vlb_candidates. select_UGAL_path()
+//keeps the candidate paths in a stack array of this size.
+#define DF_MAX_UGAL_CANDIDATES 16
+
 
 class DragonFlyFull: public Network {
     int _a;
@@ -25,6 +88,7 @@ class DragonFlyFull: public Network {
                                 //UGAL_L
                                 //UGAL_L_two_hop
                                 //UGAL_L_threshold
+                                //any of the above + _perhop, if registered
 
     string _ugal_multiply_mode;
                         //options: pathlen_based / one_vs_two
@@ -33,15 +97,39 @@ class DragonFlyFull: public Network {
                             //one_vs_two =>   Q_min * 1 <= Q_vlb * 2
     int _five_hop_percentage;
 
-    
+    int _ugal_min_candidates;   //no of MIN paths UGAL compares. Always 1 for the PAR revaluation.
+    int _ugal_vlb_candidates;   //no of VLB paths UGAL compares
+
+    string _vc_allocation_mode;
+                        //options: incremental / optimal
+
+    string _par_revaluation;
+                        //options: first_hop / source_group / source_and_intermediate_group
+
+    int _djkstra_threads;   //threads for all_pair_djkstra(). 0 = one per hardware thread.
+    int _djkstra_group_symmetry;    //1 = store djkstra rows only for one group-shift orbit representative.
+    int _djkstra_path_pool_mb;  //memory budget of the djkstra path pool. Over it, paths are cached LRU.
+    int _candidate_cache_mb;    //memory budget of each i-node candidate cache. Over it, lists are built per packet.
+    string _djkstra_path_selection;
+                        //options: pool / sample
+                        //pool = enumerate all djkstra paths once, pick one per packet
+                        //sample = no enumeration, walk the parents with path-count weights
+
     int _radix; //router radix. = _a-1 + _h + _p
     
     int _threshold; //only needed for threshold based routing.
+    int _multitiered_threshold_0;   //only needed for multi-tiered routing. min path q_len below it -> tier 1
+    int _multitiered_threshold_1;   //below it -> tier 2, otherwise tier 3
     
     int _local_latency;  //link latency. 
     int _global_latency;
 
-    string _arrangement;
+    string _arrangement;    //absolute_improved / relative / circulant / random
+    int _arrangement_seed;  //only for the random arrangement
+
+    string _topology_file;  //if set, the router graph is written here for PathSetOptimizer
+    string _vlb_inode_table_file;   //i-node table of the *_table routing modes
+    string _snapshot_dir;   //if set, the constructor tables are saved here and mapped back on later runs
     
     void _setGlobals();
     void _setRoutingMode();
@@ -51,22 +139,39 @@ class DragonFlyFull: public Network {
 
     void _BuildGraphForLocal();
     void _BuildGraphForGlobal(string arrangement);
+    void _ArrangeGlobalLinksAbsoluteImproved(std::vector< std::pair<int,int> > &global_links);
+    void _ArrangeGlobalLinksByOffset(const std::vector<int> &offsets, std::vector< std::pair<int,int> > &global_links);
+    void _ArrangeGlobalLinksRandom(std::vector< std::pair<int,int> > &global_links);
+    void _ReportTopologyQuality();
     void _CreatePortMap();
+    void _WriteTopology(const string &file_name);
     
+    int _FindGroupShiftPeriod();
     void _discover_djkstra_paths();
     void _generate_two_hop_neighbors();
     void _generate_one_hop_neighbors();
     void _generate_common_neighbors_for_group_pair();
 
+    string _SnapshotFileName(uint64_t &key);
+    bool _LoadSnapshot();
+    bool _WriteSnapshot();
+
 
 public:
     DragonFlyFull (const Configuration &config, const string & name);
     static void RegisterRoutingFunctions();
 };
 
-int select_shortest_path(int src_router, int dst_router, std::vector<int> & pathVector);
-int select_shortest_path_djkstra(int src_router, int dst_router, std::vector<int> & pathVector);    
+//signatures of the i-node selector and path flavor template arguments of the routing kernels
+typedef int (*imdt_node_selector_t)(const Flit *f, int src_router, int dst_router, int min_q_len);
+typedef int (*shortest_path_selector_t)(int src_router, int dst_router, DFPath & pathVector);
+
+int select_shortest_path(int src_router, int dst_router, DFPath & pathVector);
+int select_shortest_path_djkstra(int src_router, int dst_router, DFPath & pathVector);
+void require_shortest_path(int result, int src_router, int dst_router);   //exits if result is not 1
 int find_port_to_node(int current_router, int next_router);
+int local_port_to_node(int current_router, int next_router);
+void port_range_to_node(int current_router, int next_router, int &first_port, int &last_port);
 
 int allocate_vc(const Flit *f, int prev_router, int current_router, int next_router, int current_vc);
 
@@ -76,16 +181,29 @@ void min_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSe
 
 /*
 VLB routing
+
+Specialized routing kernels. RegisterRoutingFunctions() registers one 
+vlb_dragonflyfull_kernel / UGAL_dragonflyfull_kernel / PAR_dragonflyfull_kernel
+instantiation per routing function name, as listed in g_routing_function_table, 
+so the i-node selector, the path flavor and the UGAL switch are compile-time 
+constants on the per-packet path. 
+The kernels branch once on the config-time vc / multiply modes and call into 
+the fully specialized *_route instantiation.
 */
-void vlb_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH>
+void vlb_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
 
-int select_vlb_path_old(int src_router, int dst_router, std::vector<int> & pathVector); //probably unnecessary
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFVcAllocationMode VC_MODE>
+void vlb_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
 
-int select_vlb_path_regular(const Flit *f, int src_router, int dst_router, std::vector<int> & pathVector);
+int select_vlb_path_old(int src_router, int dst_router, DFPath & pathVector); //probably unnecessary
 
-int select_vlb_path(const Flit *f, int src_router, int dst_router, std::vector<int> & pathVector);
+int select_vlb_path_regular(const Flit *f, int src_router, int dst_router, DFPath & pathVector);
 
-int select_vlb_path_inside_group(int src_router, int dst_router, std::vector<int> & pathVector);
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH>
+int select_vlb_path(const Flit *f, int src_router, int dst_router, DFPath & pathVector);
+
+int select_vlb_path_inside_group(int src_router, int dst_router, DFPath & pathVector);
 
 
 int vlb_intermediate_node_vanilla(const Flit *f, int src_router, int dst_router);
@@ -111,32 +229,76 @@ int vlb_imdt_node_for_five_hop_paths_src_and_dst(const Flit *f, int src_router,
 
 int vlb_imdt_node_for_four_hop_and_some_five_hop_paths(const Flit *f, int src_router, int dst_router, int five_hop_percentage);
 
+//the candidate i-nodes of the restricted modes as bitsets over all routers.
+//out and scratch are two_hop_neighbors_bits.words() long.
+void five_hop_candidate_bits(int src_router, int dst_router, uint64_t *out, uint64_t *scratch);
+void four_hop_candidate_bits(int src_router, int dst_router, uint64_t *out, uint64_t *scratch);
+void three_hop_candidate_bits(int src_router, int dst_router, uint64_t *out, uint64_t *scratch);
+
+
+//uniform-signature wrappers around the selectors above, one per DFRoutingMode
+int imdt_node_vanilla(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_five_hop_src_only(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_five_hop_src_and_dst(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_four_hop(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_three_hop(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_four_hop_some_five_hop(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_threshold(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_multitiered(const Flit *f, int src_router, int dst_router, int min_q_len);
+int imdt_node_table(const Flit *f, int src_router, int dst_router, int min_q_len);
+
+int multitiered_tier(int min_q_len);
+
 
-int generate_vlb_path_from_given_imdt_node(int src_router, int dst_router, int imdt_router,  std::vector<int> & pathVector, string shortest_path_mode);
 
-int generate_imdt_nodes(const Flit *f, int src_router, int dst_router, int no_of_nodes_to_generate, std::vector<int> & imdt_nodes, string routing_mode, int min_q_len);
+int generate_vlb_path_from_given_imdt_node(int src_router, int dst_router, int imdt_router,  DFPath & pathVector, shortest_path_selector_t shortest_path);
+
+template <imdt_node_selector_t SELECT_IMDT>
+int generate_imdt_nodes(const Flit *f, int src_router, int dst_router, int no_of_nodes_to_generate, int *imdt_nodes, int min_q_len);
 
 /*
 UGAL routing
 */
-void UGAL_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalSwitch UGAL_SWITCH>
+void UGAL_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalSwitch UGAL_SWITCH, DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void UGAL_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
 
-int select_UGAL_path(const Router *r, const Flit *f, int src_router, int dst_router, std::vector<int> & pathVector, string routing_mode);
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalSwitch UGAL_SWITCH, DFUgalMultiplyMode MULTIPLY_MODE>
+int select_UGAL_path(const Router *r, const Flit *f, int src_router, int dst_router, DFPath & pathVector);
 
-int make_UGAL_L_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, std::vector< std::vector<int> > paths, int chosen_tier);
+template <DFUgalMultiplyMode MULTIPLY_MODE>
+int make_UGAL_L_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, const DFPath *paths, int chosen_tier);
 
-int make_UGAL_G_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, std::vector< std::vector<int> > paths, int chosen_tier);
+int make_UGAL_G_path_choice(const Router *r, const Flit *f, int no_of_min_paths_to_consider, int no_of_VLB_paths_to_consider, const DFPath *paths, int chosen_tier);
 
 int find_port_queue_len_to_node(const Router *r, int current_router, int next_router);
 
-int generate_in_group_vlb_paths(const Flit *f, int src_router, int dst_router, int no_of_nodes_to_generate, std::vector< std::vector<int> >::iterator start, std::vector< std::vector<int> >::iterator finish);
+int generate_in_group_vlb_paths(const Flit *f, int src_router, int dst_router, DFPath *start, DFPath *finish);
 
 
 
 /*
 PAR routing
 */
-void PAR_dragonflyfull( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH>
+void PAR_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+
+template <imdt_node_selector_t SELECT_IMDT, shortest_path_selector_t VLB_SHORTEST_PATH, DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void PAR_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+
+/*
+Per-hop routing, no path in the flit. See perhop_route().
+*/
+template <imdt_node_selector_t SELECT_IMDT, DFPerHopChoice CHOICE>
+void perhop_dragonflyfull_kernel( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+
+template <imdt_node_selector_t SELECT_IMDT, DFPerHopChoice CHOICE, DFUgalMultiplyMode MULTIPLY_MODE, DFVcAllocationMode VC_MODE>
+void perhop_route( const Router *r, const Flit *f, int in_channel, OutputSet *outputs, bool inject);
+
+template <imdt_node_selector_t SELECT_IMDT, DFPerHopChoice CHOICE, DFUgalMultiplyMode MULTIPLY_MODE>
+int perhop_source_choice(const Router *r, const Flit *f, int src_router, int dst_router);
 
 //just for testing
 void print_2d_vector(std::vector < std::vector <int> > &vect);
@@ -144,9 +306,6 @@ void print_2d_vector(std::vector < std::vector <int> > &vect);
 template <typename T>
 void print_container(T &container);
 
-template <typename T>
-void fisher_yates_shuffle(T &container, int size);
-
 //for ugal path comparison stat collection
 void log_ugal_stats(int min_or_vlb_choice, int min_multiplier, int vlb_multiplier);
 
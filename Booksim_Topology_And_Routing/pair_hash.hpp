@@ -2,6 +2,7 @@
 #define _Pair_hash_HPP_
 
 #include <functional>
+#include <cstdint>
 
 //this is to facilitate the use of an <int, int> pair as the key of an unordered_map.
 //STL does not know how to hash a pair, so using a pair as key throws up an error.
@@ -9,14 +10,26 @@
 //Alternatively, we could use the boost::hash function, but that would require boost
 //library to be installed in every machine we run the code. Too much overhead.
 
+//The old version was hash(first) ^ hash(second). With the identity std::hash<int>
+//that makes (a,b) and (b,a) collide and every (x,x) land in bucket 0, and all our
+//maps store both directions of a pair. So pack the pair into one 64-bit key and run
+//it through the splitmix64 finalizer, which spreads every input bit over the output.
+
 struct pair_hash{
     // long int operator() (const std::pair<int, int> &p) const{
     //     long int res = p.first * 100000 + p.second;
     //     return res;
     // }
     std::size_t operator() (const std::pair<int, int> &p) const{
-        std::size_t res = std::hash<int>()(p.first) ^ std::hash<int>()(p.second);
-        return res;
+        uint64_t key = ((uint64_t)(uint32_t)p.first << 32) | (uint32_t)p.second;
+        
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        
+        return (std::size_t)key;
     }
 };
 
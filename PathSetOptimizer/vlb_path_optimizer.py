@@ -0,0 +1,443 @@
+'''
+Offline VLB path-set optimizer for the dragonfly_full topology in Booksim.
+
+Instead of a fixed rule (three_hop, four_hop, four_hop_some_five_hop ...), pick
+the i-nodes of every (src, dst) router pair from a score, and write them as a
+binary table that DragonFlyFull loads for the vlb_table / UGAL_L_table /
+UGAL_G_table / PAR_table routing functions.
+
+Workflow:
+
+    1. Run Booksim once with df_topology_file = <file> in the config. DragonFlyFull
+       writes its router graph there (any routing function will do).
+    2. python3 vlb_path_optimizer.py <topology file> <table file> [options]
+    3. Run Booksim with routing_function = UGAL_L_table (or another *_table one)
+       and vlb_inode_table = <table file>.
+
+    The table carries the hash of the topology, so it is refused for any other
+    a, g or arrangement.
+
+How the i-nodes are picked:
+
+    Paths:
+        Halves of a VLB path are djkstra paths (local link weight 1, global 3),
+        like the restricted modes use. Traffic of a half is split evenly over
+        all its shortest paths. For every router pair we keep the mean hop
+        count and the share of the traffic on every global link.
+
+    Start:
+        For every pair with src and dst in different groups, all the i-nodes
+        whose VLB path is at most --max-hops long. If that gives fewer than
+        --min-inodes, the next shortest ones are added.
+
+    Load:
+        Traffic patterns are uniform random and group shift by each of
+        --shifts. A pair sends its share of a pattern evenly through its
+        i-nodes. The load of a global link is normalized by the mean global
+        link load of the pattern, so 1.0 is perfect balance.
+
+    Repair:
+        Take the global links with the highest normalized load over all the
+        patterns. For the pairs putting the most traffic on them, swap the
+        i-node that uses the hot link most for the shortest i-node not in the
+        set whose links are all less loaded (at most --slack hops longer).
+        Repeat for --rounds rounds or until no swap helps.
+
+    Only the global links are balanced. The local links of a group are all
+    the same kind, and any VLB rule loads them alike.
+'''
+
+import argparse
+import array
+import heapq
+import random
+import struct
+import sys
+
+
+LOCAL_LINK_WEIGHT = 1
+GLOBAL_LINK_WEIGHT = 3
+
+DF_VLB_TABLE_MAGIC = 0x54564644     #"DFVT", has to match df_vlb_table.hpp
+DF_VLB_TABLE_VERSION = 1
+
+
+def read_topology(filename):
+    '''
+    Reads the file DragonFlyFull::_WriteTopology() writes.
+    Returns a dict with a, g, h, p, N, hash and edges, a list of (src, dst, weight, width)
+    in the order of the file.
+    '''
+    with open(filename) as f:
+        header = f.readline().split()
+        if header != ["dragonfly_full_topology", "1"]:
+            sys.exit("Error! " + filename + " is not a dragonfly_full topology file.")
+
+        a, g, h, p, N = [int(x) for x in f.readline().split()]
+        key, topology_hash = f.readline().split()
+        if key != "topology_hash":
+            sys.exit("Error! no topology_hash in " + filename)
+
+        edges = []
+        for line in f:
+            if line.strip() == "":
+                continue
+            src, dst, weight, width = [int(x) for x in line.split()]
+            edges.append((src, dst, weight, width))
+
+    topology = {"a": a, "g": g, "h": h, "p": p, "N": N, "hash": int(topology_hash, 16), "edges": edges}
+
+    if topology_hash_of(topology) != topology["hash"]:
+        sys.exit("Error! topology_hash does not match the links in " + filename)
+
+    return topology
+
+
+def topology_hash_of(topology):
+    #same FNV-1a as df_topology_hash() in df_vlb_table.cpp
+    mask = (1 << 64) - 1
+    value = 0xcbf29ce484222325
+
+    def hash_word(value, word):
+        for ii in range(4):
+            value ^= (word >> (8 * ii)) & 0xFF
+            value = (value * 0x100000001b3) & mask
+        return value
+
+    value = hash_word(value, topology["N"])
+    for (src, dst, weight, width) in topology["edges"]:
+        for word in (src, dst, weight, width):
+            value = hash_word(value, word)
+    return value
+
+
+def djkstra_from(src, adjacency, N):
+    '''
+    Distances, no of shortest paths, mean hop count and parents from src.
+    Also gives the nodes in the order they were settled, parents come first.
+    '''
+    INF = float("inf")
+    distance = [INF] * N
+    path_count = [0] * N
+    parents = [[] for _ in range(N)]
+    settled = [False] * N
+    order = []
+
+    distance[src] = 0
+    path_count[src] = 1
+    heap = [(0, src)]
+
+    while heap:
+        dist, node = heapq.heappop(heap)
+        if settled[node]:
+            continue
+        settled[node] = True
+        order.append(node)
+
+        for (nbr, weight) in adjacency[node]:
+            new_dist = dist + weight
+            if new_dist < distance[nbr]:
+                distance[nbr] = new_dist
+                path_count[nbr] = path_count[node]
+                parents[nbr] = [node]
+                heapq.heappush(heap, (new_dist, nbr))
+            elif new_dist == distance[nbr]:
+                path_count[nbr] += path_count[node]
+                parents[nbr].append(node)
+
+    mean_hops = [0.0] * N
+    for node in order:
+        if node == src:
+            continue
+        mean_hops[node] = sum(path_count[par] * (mean_hops[par] + 1) for par in parents[node]) / path_count[node]
+
+    return distance, path_count, parents, mean_hops, order
+
+
+def shortest_path_tables(topology):
+    '''
+    For every (src, dst):
+        hops[src][dst]:  mean hop count of the shortest paths
+        usage[src][dst]: list of (global link id, share of the traffic on it)
+    Also returns the global links as a list of (src, dst), indexed by link id.
+    '''
+    N = topology["N"]
+    adjacency = [[] for _ in range(N)]
+    global_link_id = {}
+    global_links = []
+
+    for (src, dst, weight, width) in topology["edges"]:
+        adjacency[src].append((dst, weight))
+        if weight == GLOBAL_LINK_WEIGHT:
+            global_link_id[(src, dst)] = len(global_links)
+            global_links.append((src, dst))
+
+    hops = []
+    usage = []
+
+    for src in range(N):
+        distance, path_count, parents, mean_hops, order = djkstra_from(src, adjacency, N)
+        hops.append(mean_hops)
+
+        usage_row = []
+        for dst in range(N):
+            #walk back from dst, a node's traffic goes to its parents in proportion
+            #to their path counts
+            if dst == src:
+                usage_row.append([])
+                continue
+            share = {dst: 1.0}
+            links = {}
+            for node in reversed(order):
+                if node not in share or node == src:
+                    continue
+                for par in parents[node]:
+                    part = share[node] * path_count[par] / path_count[node]
+                    share[par] = share.get(par, 0.0) + part
+                    link = global_link_id.get((par, node))
+                    if link is not None:
+                        links[link] = links.get(link, 0.0) + part
+            usage_row.append(list(links.items()))
+        usage.append(usage_row)
+
+    return hops, usage, global_links
+
+
+def vlb_path(src, dst, inode, hops, usage):
+    #hop count and global link shares of the VLB path src -> inode -> dst
+    links = {}
+    for (link, part) in usage[src][inode]:
+        links[link] = links.get(link, 0.0) + part
+    for (link, part) in usage[inode][dst]:
+        links[link] = links.get(link, 0.0) + part
+    return hops[src][inode] + hops[inode][dst], links
+
+
+def traffic_patterns(a, g, shifts):
+    '''
+    List of (name, weight function). weight(src, dst) is the share of src's
+    traffic that goes to dst, only pairs in different groups count.
+    '''
+    N = a * g
+    patterns = [("uniform", lambda src, dst: 1.0 / (N - a))]
+    for shift in shifts:
+        def group_shift(src, dst, shift = shift):
+            return 1.0 / a if (dst // a) == ((src // a) + shift) % g else 0.0
+        patterns.append(("group_shift_" + str(shift), group_shift))
+    return patterns
+
+
+class PathSet:
+    '''
+    The i-nodes of every pair and the global link loads they cause.
+    '''
+    def __init__(self, topology, hops, usage, global_links, patterns):
+        self.a = topology["a"]
+        self.N = topology["N"]
+        self.hops = hops
+        self.usage = usage
+        self.num_links = len(global_links)
+        self.patterns = patterns
+
+        self.inodes = {}        #(src, dst) -> list of i-nodes
+        self.weights = {}       #(src, dst) -> weight in every pattern
+        self.load = [[0.0] * self.num_links for _ in patterns]
+        self.users = [dict() for _ in range(self.num_links)]    #link -> {pair: unweighted share}
+
+        for src in range(self.N):
+            for dst in range(self.N):
+                if src // self.a != dst // self.a:
+                    self.weights[(src, dst)] = [weight(src, dst) for (name, weight) in patterns]
+
+    def _apply(self, pair, inode, sign):
+        src, dst = pair
+        length, links = vlb_path(src, dst, inode, self.hops, self.usage)
+        size = len(self.inodes[pair])
+        for (link, part) in links.items():
+            for pp, weight in enumerate(self.weights[pair]):
+                self.load[pp][link] += sign * weight * part / size
+            users = self.users[link]
+            users[pair] = users.get(pair, 0.0) + sign * part
+            if users[pair] <= 1e-12:
+                del users[pair]
+
+    def set_inodes(self, pair, inodes):
+        if pair in self.inodes:
+            for inode in self.inodes[pair]:
+                self._apply(pair, inode, -1)
+        self.inodes[pair] = list(inodes)
+        for inode in self.inodes[pair]:
+            self._apply(pair, inode, +1)
+
+    def swap(self, pair, old_inode, new_inode):
+        self._apply(pair, old_inode, -1)
+        self.inodes[pair][self.inodes[pair].index(old_inode)] = new_inode
+        self._apply(pair, new_inode, +1)
+
+    def mean_load(self, pp):
+        return sum(self.load[pp]) / self.num_links
+
+    def hot_links(self, tolerance):
+        '''
+        The pattern with the most loaded global link, its normalized load and
+        all the links of that pattern within tolerance of it, most loaded first.
+        '''
+        peak, worst_pp = 0.0, 0
+        for pp in range(len(self.patterns)):
+            mean = self.mean_load(pp)
+            if mean > 0 and max(self.load[pp]) / mean > peak:
+                peak, worst_pp = max(self.load[pp]) / mean, pp
+        mean = self.mean_load(worst_pp)
+        links = [link for link in range(self.num_links) if self.load[worst_pp][link] >= (1 - tolerance) * peak * mean]
+        links.sort(key = lambda link: -self.load[worst_pp][link])
+        return peak, worst_pp, links
+
+    def report(self, title):
+        print(title)
+        for pp, (name, weight) in enumerate(self.patterns):
+            mean = sum(self.load[pp]) / self.num_links
+            peak = max(self.load[pp]) / mean if mean > 0 else 0.0
+            total_hops = 0.0
+            total_weight = 0.0
+            for pair, inodes in self.inodes.items():
+                weight_of_pair = self.weights[pair][pp]
+                if weight_of_pair == 0:
+                    continue
+                src, dst = pair
+                for inode in inodes:
+                    total_hops += weight_of_pair * (self.hops[src][inode] + self.hops[inode][dst]) / len(inodes)
+                total_weight += weight_of_pair
+            print("    %-16s max global link load / mean: %6.3f   mean VLB hops: %5.3f" % (name, peak, total_hops / total_weight))
+        sizes = [len(inodes) for inodes in self.inodes.values()]
+        print("    i-nodes per pair: min %d  mean %.2f  max %d" % (min(sizes), sum(sizes) / len(sizes), max(sizes)))
+
+
+def initial_inodes(src, dst, a, N, hops, max_hops, min_inodes, rng):
+    #all i-nodes up to max_hops, or the min_inodes shortest ones
+    candidates = [m for m in range(N) if (m // a != src // a) and (m // a != dst // a)]
+    rng.shuffle(candidates)     #random tie break between equally long ones
+    candidates.sort(key = lambda m: hops[src][m] + hops[m][dst])
+
+    chosen = [m for m in candidates if hops[src][m] + hops[m][dst] <= max_hops + 1e-9]
+    if len(chosen) < min_inodes:
+        chosen = candidates[:min_inodes]
+    return chosen, candidates
+
+
+def repair(path_set, candidates, rounds, slack, pairs_per_round, tolerance = 0.01):
+    '''
+    Move VLB traffic off the hottest global links, see the module comment.
+    All the links within tolerance of the hottest are worked on in a round,
+    a symmetric arrangement has many of them.
+    '''
+    hops = path_set.hops
+    best_peak = float("inf")
+    stalled = 0
+    for rnd in range(rounds):
+        peak, pp, links = path_set.hot_links(tolerance)
+
+        #swaps can just move load around between the hot links of a router
+        if peak < best_peak - 1e-9:
+            best_peak = peak
+            stalled = 0
+        else:
+            stalled += 1
+            if stalled == 5:
+                print("round %d: hottest links stuck at %.3f, stopping" % (rnd, peak))
+                break
+        limit = (1 - tolerance) * peak * path_set.mean_load(pp)     #a swapped in path has to stay below this
+        swapped = 0
+
+        for hot_link in links:
+            #pairs with traffic in the worst pattern that use the hot link, most first
+            users = [(share * path_set.weights[pair][pp] / len(path_set.inodes[pair]), pair) for (pair, share) in path_set.users[hot_link].items() if path_set.weights[pair][pp] > 0]
+            users.sort(reverse = True)
+
+            for (contribution, pair) in users[:pairs_per_round]:
+                src, dst = pair
+                #the member that puts the most on the hot link
+                worst = max(path_set.inodes[pair], key = lambda m: vlb_path(src, dst, m, hops, path_set.usage)[1].get(hot_link, 0.0))
+                worst_len = hops[src][worst] + hops[worst][dst]
+                in_set = set(path_set.inodes[pair])
+
+                for m in candidates[pair]:
+                    if m in in_set:
+                        continue
+                    length, new_links = vlb_path(src, dst, m, hops, path_set.usage)
+                    if length > worst_len + slack + 1e-9:
+                        break   #candidates are sorted by length
+                    if hot_link in new_links:
+                        continue
+                    if all(path_set.load[pp][link] < limit for link in new_links):
+                        path_set.swap(pair, worst, m)
+                        swapped += 1
+                        break
+
+        if swapped == 0:
+            print("round %d: no swap lowers the hottest links (%.3f), stopping" % (rnd, peak))
+            break
+
+        if rnd % 10 == 0:
+            print("round %d: %d hot links at %.3f (%s), %d swaps" % (rnd, len(links), peak, path_set.patterns[pp][0], swapped))
+
+
+def write_table(filename, topology, path_set):
+    #binary layout of df_vlb_table.hpp
+    N = topology["N"]
+    offsets = array.array("I", [0])
+    nodes = array.array("H")
+
+    for src in range(N):
+        for dst in range(N):
+            for inode in sorted(path_set.inodes.get((src, dst), [])):
+                nodes.append(inode)
+            offsets.append(len(nodes))
+
+    if sys.byteorder != "little":
+        offsets.byteswap()
+        nodes.byteswap()
+
+    with open(filename, "wb") as f:
+        f.write(struct.pack("<IIIIQ", DF_VLB_TABLE_MAGIC, DF_VLB_TABLE_VERSION, N, 0, topology["hash"]))
+        f.write(offsets.tobytes())
+        f.write(nodes.tobytes())
+
+    print("wrote %s: %d pairs, %d i-nodes" % (filename, len(path_set.inodes), len(nodes)))
+
+
+def optimize(topology_file, table_file, max_hops, min_inodes, shifts, rounds, slack, pairs_per_round, seed):
+    topology = read_topology(topology_file)
+    a, g, N = topology["a"], topology["g"], topology["N"]
+    print("topology: a %d  g %d  h %d  N %d  hash %016x" % (a, g, topology["h"], N, topology["hash"]))
+
+    hops, usage, global_links = shortest_path_tables(topology)
+    patterns = traffic_patterns(a, g, [s for s in shifts if s % g != 0])
+
+    rng = random.Random(seed)
+    path_set = PathSet(topology, hops, usage, global_links, patterns)
+    candidates = {}
+    for (src, dst) in path_set.weights:
+        chosen, candidates[(src, dst)] = initial_inodes(src, dst, a, N, hops, max_hops, min_inodes, rng)
+        path_set.set_inodes((src, dst), chosen)
+
+    path_set.report("initial path sets (max %d hops, at least %d i-nodes):" % (max_hops, min_inodes))
+    repair(path_set, candidates, rounds, slack, pairs_per_round)
+    path_set.report("after repair:")
+
+    write_table(table_file, topology, path_set)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description = "Pick VLB i-nodes per router pair for the dragonfly_full *_table routing functions.")
+    parser.add_argument("topology_file", help = "written by Booksim with df_topology_file set")
+    parser.add_argument("table_file", help = "binary i-node table, for vlb_inode_table in the Booksim config")
+    parser.add_argument("--max-hops", type = int, default = 4, help = "longest VLB path in the initial sets (default 4)")
+    parser.add_argument("--min-inodes", type = int, default = 4, help = "at least this many i-nodes per pair (default 4)")
+    parser.add_argument("--shifts", type = int, nargs = "*", default = [1], help = "group shifts of the adversarial patterns (default 1)")
+    parser.add_argument("--rounds", type = int, default = 100, help = "repair rounds (default 100)")
+    parser.add_argument("--slack", type = int, default = 1, help = "a swapped in i-node may be this many hops longer (default 1)")
+    parser.add_argument("--pairs-per-round", type = int, default = 16, help = "pairs tried per repair round (default 16)")
+    parser.add_argument("--seed", type = int, default = 1, help = "for the tie breaks (default 1)")
+    args = parser.parse_args()
+
+    optimize(args.topology_file, args.table_file, args.max_hops, args.min_inodes, args.shifts, args.rounds, args.slack, args.pairs_per_round, args.seed)